@@ -0,0 +1,548 @@
+/*
+ * 性能测试, 各项的结果写到标准错误:
+ *
+ *     myre_bench [CASE...]
+ *
+ * 不指定CASE时全部运行. 需要C++11, 例如 c++ -O2 -std=c++11 -pthread myre_bench.cpp.
+ * myre.h定义了_RE_DEBUG时, 编译表达式的调试信息写到标准输出, 可重定向到/dev/null.
+ * generated一项需要先用myregen在本目录生成三个头文件, 再加-DMYRE_BENCH_GEN编译:
+ *
+ *     myregen ipv4 '(\d\d?\d?\.){3}\d\d?\d?' gen_ipv4.h
+ *     myregen email '\w+@(\w+\.)+\w+' gen_email.h
+ *     myregen hex '0x[0-9a-fA-F]+' gen_hex.h
+ */
+#include <chrono>
+#include <string>
+#include <thread>
+#include "../myre.h"
+#ifdef MYRE_BENCH_GEN
+#include "gen_ipv4.h"
+#include "gen_email.h"
+#include "gen_hex.h"
+#endif
+
+using namespace myre;
+
+static volatile size_t keep;  // 存放测量的结果, 防止被优化掉
+static int failed;
+
+// 顺带检查结果, 不符时报告并让main返回1
+static void check(bool ok, const char* what)
+{
+    if (!ok)
+    {
+        fprintf(stderr, "  CHECK FAILED: %s\n", what);
+        failed = 1;
+    }
+}
+
+static double now()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 每轮重复f至少0.2秒, 取三轮中最快的一次, 返回秒数
+template <class F> static double timeit(F f)
+{
+    double best = 1e30;
+    for (int round = 0; round < 3; round++)
+    {
+        size_t k = 0;
+        double t0 = now(), t;
+        do
+        {
+            f();
+            k++;
+        } while ((t = now() - t0) < 0.2);
+        best = t / k < best? t / k: best;
+    }
+    return best;
+}
+
+static void report(const char* name, size_t bytes, double sec)
+{
+    fprintf(stderr, "  %-44s %10.2f MB/s\n", name, bytes / sec / 1e6);
+}
+
+static void report_ms(const char* name, double sec)
+{
+    fprintf(stderr, "  %-44s %10.3f ms\n", name, sec * 1e3);
+}
+
+// 从alphabet中伪随机取len个字节, 每次运行相同
+static std::string text(size_t len, const char* alphabet, unsigned seed = 1)
+{
+    std::string s(len, ' ');
+    size_t n = strlen(alphabet);
+    for (size_t i = 0; i < len; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        s[i] = alphabet[(seed >> 16) % n];
+    }
+    return s;
+}
+
+static const unsigned char* begin_of(const std::string& s)
+{
+    return (const unsigned char*)s.data();
+}
+
+static const unsigned char* end_of(const std::string& s)
+{
+    return (const unsigned char*)s.data() + s.size();
+}
+
+/*
+ * 状态数在THR两侧的同类表达式, 分别走8位转移表的_bthr和16位转移表的_athr.
+ * (a|b)*不会失败, match读完整个输入; BAD_CHAR_OPT时search直接用各自的搜索循环
+ */
+static void bench_athr()
+{
+    std::string ab = text(1 << 24, "ab");
+    std::string abc = text(1 << 24, "aabbc");
+    const char* pats[] = {"(a|b)*a(a|b){5}", "(a|b)*a(a|b){7}"};
+    for (size_t i = 0; i < sizeof(pats) / sizeof(pats[0]); i++)
+    {
+        myre_t re;
+        re.compile(pats[i], BAD_CHAR_OPT);
+        char name[96];
+        fprintf(stderr, " %s: %u states, %s\n", pats[i], (unsigned)re._num, re._trans? "_bthr": "_athr");
+        report("match", ab.size(), timeit([&]() { keep = re.match(begin_of(ab), end_of(ab)) != NULL; }));
+        size_t n = 0;
+        double t = timeit([&]()
+        {
+            results_t r;
+            n = re.search(begin_of(abc), end_of(abc), r, SEARCH_ALL);
+        });
+        snprintf(name, sizeof(name), "search (%u matches)", (unsigned)n);
+        report(name, abc.size(), t);
+    }
+}
+
+/*
+ * 与__search_without_prefix_bthr(_athr)相同的循环, 转移表每行1 << shift列, cls把字节映射到列,
+ * bad及以上为死状态
+ */
+template <class T> static size_t search_table(const T* trans, const unsigned char* cls, size_t shift, T bad,
+                                              const bool* accept, const unsigned char* p, const unsigned char* e)
+{
+    size_t n = 0;
+    while (p < e)
+    {
+        size_t s = 0;
+        const unsigned char *x = p, *y = NULL;
+        while (x < e && (s = trans[(s << shift) + cls[*x++]]) < bad)
+        {
+            if (accept[s])
+            {
+                y = x;
+            }
+        }
+        n += y != NULL;
+        p = y? y: p + 1;
+    }
+    return n;
+}
+
+template <class T> static void compare_layouts(myre_t& re, const T* trans, T bad, const std::string& s)
+{
+    char name[96];
+    unsigned char ident[256];
+    T* full = (T*)malloc((re._num << 8) * sizeof(T));
+    for (int c = 0; c < 256; c++)
+    {
+        ident[c] = (unsigned char)c;
+    }
+    for (size_t t = 0; t < re._num; t++)
+    {
+        for (int c = 0; c < 256; c++)
+        {
+            full[(t << 8) + c] = trans[(t << re._cshift) + re._classes[c]];
+        }
+    }
+    const unsigned char *p = begin_of(s), *e = end_of(s);
+    double t = timeit([&]() { keep = search_table(full, ident, 8, bad, re._accept, p, e); });
+    snprintf(name, sizeof(name), "256 columns (%u KB)", (unsigned)(((re._num << 8) * sizeof(T)) >> 10));
+    report(name, s.size(), t);
+    t = timeit([&]() { keep = search_table(trans, re._classes, re._cshift, bad, re._accept, p, e); });
+    snprintf(name, sizeof(name), "byte classes (%u B + 256 B map)", (unsigned)((re._num << re._cshift) * sizeof(T)));
+    report(name, s.size(), t);
+    free(full);
+}
+
+/*
+ * 等价类压缩的转移表与展开成每行256列的表, 用同一个搜索循环比较.
+ * 输入中有各表达式用到的字符, 使扫描能走遍各个状态
+ */
+static void bench_classes()
+{
+    std::string s = text(1 << 24, "aab0123456789.@_x ");
+    const char* pats[] = {PAT_IPV4, PAT_EMAIL, "(a|b|\\d)*a(a|b|\\d){6}", "(a|b|\\d)*a(a|b|\\d){10}"};
+    for (size_t i = 0; i < sizeof(pats) / sizeof(pats[0]); i++)
+    {
+        myre_t re;
+        re.compile(pats[i], BAD_CHAR_OPT);
+        fprintf(stderr, " %s: %u states, %u columns\n", pats[i], (unsigned)re._num, 1u << re._cshift);
+        if (re._trans)
+        {
+            compare_layouts(re, re._trans, (unsigned char)0xfe, s);
+        }
+        else
+        {
+            compare_layouts(re, re._wtrans, (U16)0xfffe, s);
+        }
+    }
+}
+
+/*
+ * 编译时间随状态数的增长, 状态查找是散列表时应接近线性.
+ * 定义了_RE_DEBUG时编译还要输出每个状态, 测量前应去掉
+ */
+static void bench_compile()
+{
+    char name[96];
+    for (int k = 3; k <= 11; k += 2)
+    {
+        char pat[64];
+        size_t num = 0;
+        snprintf(pat, sizeof(pat), "(a|b|\\d)*a(a|b|\\d){%d}", k);
+        double t = timeit([&]()
+        {
+            myre_t re;
+            re.compile(pat);
+            num = re._num;
+        });
+        snprintf(name, sizeof(name), "%s (%u states)", pat, (unsigned)num);
+        report_ms(name, t);
+        fprintf(stderr, "  %-44s %10.3f us\n", "  per state", t * 1e6 / num);
+    }
+    // 服务启动时一次编译大量小表达式
+    std::string pats[1000];
+    for (int i = 0; i < 1000; i++)
+    {
+        char pat[64];
+        snprintf(pat, sizeof(pat), "key%d=[0-9a-f]{1,8}(,\\w+)*", i);
+        pats[i] = pat;
+    }
+    double t = timeit([&]()
+    {
+        for (int i = 0; i < 1000; i++)
+        {
+            myre_t re;
+            re.compile(pats[i].c_str());
+        }
+    });
+    report_ms("1000 patterns key<i>=[0-9a-f]{1,8}(,\\w+)*", t);
+}
+
+/*
+ * 日志中的N个字段: re_set_t一遍扫描 vs N个re_t各扫描一遍.
+ * 每行带几个随机的字段, 还有不属于任何表达式的文字
+ */
+static void bench_set()
+{
+    std::string s;
+    unsigned seed = 7;
+    while (s.size() < (1 << 23))
+    {
+        char line[128];
+        seed = seed * 1103515245 + 12345;
+        snprintf(line, sizeof(line), "2024-01-02 10:00:%02u INFO request done f%u=%u f%u=%u from 10.0.%u.%u\n",
+                 (seed >> 8) % 60, (seed >> 12) % 64, seed >> 20, (seed >> 16) % 64, (seed >> 4) & 0xfff, (seed >> 24) & 0xff, seed & 0xff);
+        s += line;
+    }
+    char name[96];
+    for (size_t n = 4; n <= 32; n *= 2)
+    {
+        std::string exps[32];
+        const char* ptrs[32];
+        myre_t res[32];
+        for (size_t i = 0; i < n; i++)
+        {
+            char pat[32];
+            snprintf(pat, sizeof(pat), "f%u=\\d+", (unsigned)i);
+            exps[i] = pat;
+            ptrs[i] = exps[i].c_str();
+            res[i].compile(ptrs[i]);
+        }
+        myre_set_t set(ptrs, n);
+        check(set.pattern_count() == n, "re_set_t::pattern_count");
+        check(set.contains(s.c_str()) && !set.contains("x=1 f=2"), "re_set_t::contains");
+        size_t found = 0;
+        double t = timeit([&]()
+        {
+            set_results_t r;
+            found = set.search(begin_of(s), end_of(s), r);
+        });
+        snprintf(name, sizeof(name), "%u patterns, re_set_t (%u matches)", (unsigned)n, (unsigned)found);
+        report(name, s.size(), t);
+        t = timeit([&]()
+        {
+            found = 0;
+            for (size_t i = 0; i < n; i++)
+            {
+                results_t r;
+                found += res[i].search(begin_of(s), end_of(s), r, SEARCH_ALL);
+            }
+        });
+        snprintf(name, sizeof(name), "%u patterns, %u x re_t (%u matches)", (unsigned)n, (unsigned)n, (unsigned)found);
+        report(name, s.size(), t);
+        // 各表达式的匹配互不重叠, 合在一起的匹配个数等于分别搜索的总数
+        check(set.count(s.c_str()) == found, "re_set_t::count");
+    }
+}
+
+/*
+ * 逐个起点重试时代价高的输入: \w+\d从每个起点都扫描到末尾才失败, 长度每翻4倍吞吐量降为1/4;
+ * 一串数字中每个起点都要读几个字节才知道不是IPv4地址.
+ * BAD_CHAR_OPT时仍是逐个起点重试的循环, 默认的三段式搜索和LINEAR_SEARCH应与长度无关
+ */
+static void bench_adversarial()
+{
+    struct
+    {
+        const char* pat;
+        const char* alphabet;
+    } inputs[] = {{"\\w+\\d", "abcdefgh"}, {PAT_IPV4, "0123456789."}};
+    struct
+    {
+        const char* name;
+        long flag;
+    } modes[] = {{"restart (BAD_CHAR_OPT)", BAD_CHAR_OPT}, {"three-phase", 0}, {"LINEAR_SEARCH", LINEAR_SEARCH}};
+    char name[96];
+    for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++)
+    {
+        fprintf(stderr, " %s over [%s]\n", inputs[i].pat, inputs[i].alphabet);
+        for (size_t len = 1 << 12; len <= 1 << 16; len <<= 2)
+        {
+            std::string s = text(len, inputs[i].alphabet);
+            for (size_t k = 0; k < sizeof(modes) / sizeof(modes[0]); k++)
+            {
+                myre_t re;
+                re.compile(inputs[i].pat, modes[k].flag);
+                double t = timeit([&]()
+                {
+                    results_t r;
+                    keep = re.search(begin_of(s), end_of(s), r, SEARCH_ALL);
+                });
+                snprintf(name, sizeof(name), "%6u KB %s", (unsigned)(len >> 10), modes[k].name);
+                report(name, s.size(), t);
+            }
+        }
+    }
+}
+
+/*
+ * search_parallel的线程数从1翻倍到CPU核数(至少到4), 按行和整体各测一次.
+ * 整体搜索要求匹配长度有上限, 用PAT_IPV4
+ */
+static void bench_parallel()
+{
+    std::string s;
+    unsigned seed = 3;
+    while (s.size() < (1 << 26))
+    {
+        char line[128];
+        seed = seed * 1103515245 + 12345;
+        snprintf(line, sizeof(line), "GET /index.html 200 %u bytes from 192.168.%u.%u\n",
+                 seed >> 16, (seed >> 8) & 0xff, seed & 0xff);
+        s += line;
+    }
+    size_t cores = std::thread::hardware_concurrency();
+    size_t top = cores > 4? cores: 4;
+    myre_t re;
+    re.compile(PAT_IPV4);
+    fprintf(stderr, " %u MB, %u cores\n", (unsigned)(s.size() >> 20), (unsigned)cores);
+    char name[96];
+    for (int lines = 1; lines >= 0; lines--)
+    {
+        for (size_t k = 1; k <= top; k <<= 1)
+        {
+            double t = timeit([&]()
+            {
+                results_t r;
+                keep = re.search_parallel(begin_of(s), end_of(s), r, SEARCH_ALL, lines? "\n": NULL, k);
+            });
+            snprintf(name, sizeof(name), "%s, %u threads", lines? "lines": "whole", (unsigned)k);
+            report(name, s.size(), t);
+        }
+    }
+}
+
+/*
+ * contains与search(..., SEARCH_FIRST), count与search(..., SEARCH_ALL)比较.
+ * 只在末尾有一个匹配时两者都要扫描整个输入; 第一个匹配一直延伸到末尾时, contains读到接受状态即返回.
+ * count仍要求出每个匹配的两端, 应与search(..., SEARCH_ALL)相当
+ */
+static void bench_contains()
+{
+    std::string dense = text(1 << 24, "abcdefx0123456789..@@  \n");
+    struct
+    {
+        const char* pat;
+        const char* alphabet;  // 到处是可能的起点, 但不会出现匹配
+        const char* head;      // 以head开头, 之后全是tail中的字节时, 匹配延伸到末尾
+        const char* tail;
+    } inputs[] =
+    {
+        {PAT_IPV4, "0123456789 ", NULL, NULL},
+        {PAT_EMAIL, "abcdef@ ", "a@b.", "abcdef"},
+        {PAT_HEX, "0Xg ", "0x", "0123456789abcdef"},
+    };
+    char name[96];
+    for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++)
+    {
+        myre_t re;
+        re.compile(inputs[i].pat);
+        fprintf(stderr, " %s\n", inputs[i].pat);
+        std::string s = text(1 << 24, inputs[i].alphabet) + " 10.0.0.1 a.b@c.d 0x1f";
+        const unsigned char *b = begin_of(s), *e = end_of(s);
+        report("match at the end, search(SEARCH_FIRST)", s.size(), timeit([&]()
+        {
+            results_t r;
+            keep = re.search(b, e, r, SEARCH_FIRST);
+        }));
+        report("match at the end, contains", s.size(), timeit([&]() { keep = re.contains(b, e); }));
+        if (inputs[i].head)
+        {
+            s = inputs[i].head + text(1 << 24, inputs[i].tail);
+            b = begin_of(s);
+            e = end_of(s);
+            report_ms("one long match, search(SEARCH_FIRST)", timeit([&]()
+            {
+                results_t r;
+                keep = re.search(b, e, r, SEARCH_FIRST);
+            }));
+            report_ms("one long match, contains", timeit([&]() { keep = re.contains(b, e); }));
+        }
+        b = begin_of(dense);
+        e = end_of(dense);
+        size_t n = 0;
+        double t = timeit([&]()
+        {
+            results_t r;
+            n = re.search(b, e, r, SEARCH_ALL);
+        });
+        snprintf(name, sizeof(name), "dense, search(SEARCH_ALL) (%u matches)", (unsigned)n);
+        report(name, dense.size(), t);
+        report("dense, count", dense.size(), timeit([&]() { keep = re.count(b, e); }));
+        check(keep == n, "count");
+    }
+}
+
+#ifdef MYRE_BENCH_GEN
+/*
+ * myregen生成的代码与转移表解释执行比较: 在每个位置调用match, 以及找出全部匹配.
+ * 生成的name_search每次只找第一个匹配, 从上一个匹配的结尾继续调用
+ */
+static void bench_generated()
+{
+    typedef const unsigned char* (*match_t)(const unsigned char*, const unsigned char*);
+    typedef int (*search_t)(const unsigned char*, const unsigned char*, const unsigned char**, const unsigned char**);
+    struct
+    {
+        const char* pat;
+        match_t match;
+        search_t search;
+    } gens[] = {{PAT_IPV4, ipv4_match, ipv4_search}, {PAT_EMAIL, email_match, email_search}, {PAT_HEX, hex_match, hex_search}};
+    std::string s = text(1 << 24, "abcdefghijklmnopqrstuvwxyz0123456789....@@      \nxABCDEF");
+    const unsigned char *b = begin_of(s), *e = end_of(s);
+    for (size_t i = 0; i < sizeof(gens) / sizeof(gens[0]); i++)
+    {
+        myre_t re;
+        re.compile(gens[i].pat);
+        fprintf(stderr, " %s: %u states\n", gens[i].pat, (unsigned)re._num);
+        report("match at every position, table", s.size(), timeit([&]()
+        {
+            size_t n = 0;
+            for (const unsigned char* p = b; p < e; p++)
+            {
+                n += re.match(p, e) != NULL;
+            }
+            keep = n;
+        }));
+        report("match at every position, generated", s.size(), timeit([&]()
+        {
+            size_t n = 0;
+            for (const unsigned char* p = b; p < e; p++)
+            {
+                n += gens[i].match(p, e) != NULL;
+            }
+            keep = n;
+        }));
+        report("search all, table", s.size(), timeit([&]()
+        {
+            results_t r;
+            keep = re.search(b, e, r, SEARCH_ALL);
+        }));
+        report("search all, generated", s.size(), timeit([&]()
+        {
+            size_t n = 0;
+            const unsigned char *p = b, *x, *y;
+            while (p < e && gens[i].search(p, e, &x, &y))
+            {
+                n++;
+                p = y;
+            }
+            keep = n;
+        }));
+    }
+}
+#endif
+
+struct case_t
+{
+    const char* name;
+    void (*run)();
+    const char* desc;
+};
+
+static const case_t cases[] =
+{
+    {"athr", bench_athr, "16-bit table (_athr) vs 8-bit table (_bthr)"},
+    {"classes", bench_classes, "byte-class table vs 256-column table"},
+    {"compile", bench_compile, "compile time against state count"},
+    {"set", bench_set, "re_set_t vs sequential re_t searches"},
+    {"adversarial", bench_adversarial, "inputs that make restarting searches quadratic"},
+    {"parallel", bench_parallel, "search_parallel scaling over 1..N threads"},
+    {"contains", bench_contains, "contains and count vs search"},
+#ifdef MYRE_BENCH_GEN
+    {"generated", bench_generated, "myregen output vs the table interpreter"},
+#endif
+};
+
+int main(int argc, char** argv)
+{
+    size_t num = sizeof(cases) / sizeof(cases[0]);
+    for (int i = 1; i < argc; i++)
+    {
+        size_t k = 0;
+        while (k < num && strcmp(argv[i], cases[k].name))
+        {
+            k++;
+        }
+        if (k == num)
+        {
+            fprintf(stderr, "usage: %s [CASE...]\n", argv[0]);
+            for (k = 0; k < num; k++)
+            {
+                fprintf(stderr, "  %-12s %s\n", cases[k].name, cases[k].desc);
+            }
+            return 2;
+        }
+    }
+    for (size_t k = 0; k < num; k++)
+    {
+        bool selected = argc == 1;
+        for (int i = 1; i < argc; i++)
+        {
+            selected = selected || !strcmp(argv[i], cases[k].name);
+        }
+        if (selected)
+        {
+            fprintf(stderr, "%s: %s\n", cases[k].name, cases[k].desc);
+            cases[k].run();
+        }
+    }
+    return failed;
+}
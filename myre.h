@@ -1,7 +1,11 @@
 #pragma once
 #include <string>
 #include <climits>
+#include <cstddef>
+#include <cassert>
 #include <cstdlib>
+#include <cstring>
+#include <cstdio>
 
 
 #define _RE_DEBUG
@@ -30,6 +34,41 @@
 #define __must_inline(x) inline x 
 #endif
 
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__)) && !defined(_RE_NO_SIMD)
+#define _RE_X86_SIMD
+#include <immintrin.h>
+#define __target(x) __attribute__((target(x)))
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#define _RE_POSIX_IO
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#if __cplusplus >= 201103L
+#define _RE_THREADS
+#include <thread>
+#include <atomic>
+#endif
+
+// 线程局部变量: C++11之前用编译器的关键字, 都没有时多个线程不能同时编译
+#ifdef _RE_THREADS
+#define __thread_local thread_local
+#elif defined(__GNUC__) || defined(__clang__)
+#define __thread_local __thread
+#elif defined(_MSC_VER)
+#define __thread_local __declspec(thread)
+#else
+#define __thread_local
+#endif
+
+#if __cplusplus >= 201703L
+#define _RE_CONSTEXPR
+#endif
+
 #define SPACES "\t\n\v\f\r "
 #define WORD_CHARS "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ_abcdefghijklmnopqrstuvwxyz"
 #define BOUND_CHARS "\a\b\t\n\v\f\r !\"#$%&'()*+,-./:;<=>?@[\\]^`{|}~\x7f"
@@ -47,6 +86,10 @@ const long MATCH_WORD = 48;
 const long SEARCH_ALL = -1;
 const long SEARCH_FIRST = 1;
 const long BAD_CHAR_OPT = 1024;
+const long LAZY_DFA = 2048;
+const long LINEAR_SEARCH = 4096;
+const long BIT_PARALLEL = 8192;
+const long PIKE_VM = 16384;
 
 typedef signed int error_t;
 typedef unsigned short id_t;
@@ -60,6 +103,15 @@ typedef unsigned long long U64;
 typedef unsigned long word_t;  // 不同编译器unsigned long 有不同定义，后续落实
 
 const size_t THR = 128;
+const size_t MAX_STATES = 0xfffd;  // 0xfffe, 0xffff 为16位转移表保留
+const size_t LAZY_CACHE_SIZE = 1 << 20;  // 惰性DFA状态缓存的默认内存上限
+const size_t PARALLEL_CHUNK_MIN = 1 << 20;  // 并行搜索时每块的最小长度
+const size_t UNBOUNDED = (size_t)-1;
+const U16 IMAGE_VERSION = 1;  // 编译映像格式的版本
+const size_t GEN_RANGES = 3;  // 生成代码时一个状态最多用几个区间比较
+const size_t BIT_NFA_STATES = 1 << 12;  // 子集构造超过这个状态数且位置够少时改用位并行模拟
+const size_t MAX_POSITIONS = 0xfff0;  // 表达式展开后的位置数上限, 其余的留给reception和辅助位置
+const position_t NOPOS = 0xffff;
 
 // common char
 const item_type_t CHAR = 0;
@@ -100,12 +152,16 @@ const error_t ERR_HEX = ERR - 4;  // bad \x<0-f><0-f> escape
 const error_t ERR_PAT = ERR - 5;  // parentheses donot match 
 const error_t ERR_SYN = ERR - 6;  // syntax error
 const error_t ERR_EMP = ERR - 7;  // empty pattern
+const error_t ERR_FILE = ERR - 8;  // cannot open or read file
+const error_t ERR_IMAGE = ERR - 9;  // invalid compiled image
 const error_t NOT_SUPPORT = ERR - 100;
 const error_t ERR_TOO_MUCH_STATUS = NOT_SUPPORT - 1;
 const error_t ERR_RNG_NESTED = NOT_SUPPORT - 2;
+const error_t ERR_TOO_MUCH_POSITIONS = NOT_SUPPORT - 3;
 
 const int RESULTS_ENOUGH = 1;
 const int RESULTS_NOT_ENOUGH = 0;
+const int RESULTS_FAILED = -1;
 
 const word_t A = (word_t)(1) << (sizeof(word_t) * 8 - 1);
 #if __WORD_BYTES == 8
@@ -136,6 +192,162 @@ struct default_memory_allocator_t
     }
 };
 
+/*
+ * 内存池: 从MEM按块申请, 块内顺序分配, 只有最后一次分配可以原地扩展或回收,
+ * 池析构时整体归还. 构造时成为当前线程的池, 析构时恢复外层的池.
+ * 当前的池是线程局部的; 编译器不支持__thread_local时, 多个线程不能同时编译
+ */
+template <class MEM> struct _arena_t
+{
+    struct _block_t
+    {
+        _block_t* next;
+        char* top;
+        char* lim;
+    };
+
+    // 每次分配前的头部, 保持16字节对齐
+    struct _chunk_t
+    {
+        size_t size;
+        _arena_t* arena;  // 没有池时为NULL, 直接由MEM分配
+    #if __WORD_BYTES == 4
+        size_t pad[2];
+    #endif
+    };
+
+    _block_t* _blocks;
+    size_t _next;       // 下一块的大小
+    _arena_t* _outer;
+
+    _arena_t(size_t first = 1 << 16): _blocks(NULL), _next(first), _outer(current())
+    {
+        current() = this;
+    }
+
+    ~_arena_t()
+    {
+        while (_blocks)
+        {
+            _block_t* p = _blocks;
+            _blocks = p->next;
+            MEM::deallocate(p);
+        }
+        current() = _outer;
+    }
+
+    static _arena_t*& current()
+    {
+        static __thread_local _arena_t* p = NULL;
+        return p;
+    }
+
+    _chunk_t* allocate(size_t s)
+    {
+        size_t need = sizeof(_chunk_t) + ((s + 15) & ~(size_t)15);
+        if (!_blocks || size_t(_blocks->lim - _blocks->top) < need)
+        {
+            size_t head = (sizeof(_block_t) + 15) & ~(size_t)15;
+            size_t size = _next > need + head? _next: need + head;
+            _block_t* b = (_block_t*)MEM::allocate(size);
+            b->next = _blocks;
+            b->top = (char*)b + head;
+            b->lim = (char*)b + size;
+            _blocks = b;
+            _next = _next < (1 << 22)? _next << 1: _next;
+        }
+        _chunk_t* c = (_chunk_t*)_blocks->top;
+        _blocks->top += need;
+        c->size = s;
+        c->arena = this;
+        return c;
+    }
+
+    // 是最后一次分配且块内放得下时原地扩展
+    bool extend(_chunk_t* c, size_t s)
+    {
+        char* end = (char*)(c + 1) + ((c->size + 15) & ~(size_t)15);
+        char* want = (char*)(c + 1) + ((s + 15) & ~(size_t)15);
+        if (end != _blocks->top || want > _blocks->lim)
+        {
+            return false;
+        }
+        _blocks->top = want;
+        c->size = s;
+        return true;
+    }
+
+    void release(_chunk_t* c)
+    {
+        char* end = (char*)(c + 1) + ((c->size + 15) & ~(size_t)15);
+        if (end == _blocks->top)
+        {
+            _blocks->top = (char*)c;
+        }
+    }
+};
+
+/*
+ * 从当前线程的_arena_t分配的策略, 用于compile期间的临时结构;
+ * 没有池时退化为MEM, 但每次分配多一个头部
+ */
+template <class MEM> struct arena_memory_allocator_t
+{
+    typedef _arena_t<MEM> arena_t;
+    typedef typename arena_t::_chunk_t chunk_t;
+
+    static void* allocate(size_t s)
+    {
+        arena_t* a = arena_t::current();
+        chunk_t* c = a? a->allocate(s): (chunk_t*)MEM::allocate(sizeof(chunk_t) + s);
+        if (!a)
+        {
+            c->size = s;
+            c->arena = NULL;
+        }
+        return c + 1;
+    }
+
+    static void* reallocate(size_t s, void* p)
+    {
+        if (!p)
+        {
+            return allocate(s);
+        }
+        chunk_t* c = (chunk_t*)p - 1;
+        if (!c->arena)
+        {
+            c = (chunk_t*)MEM::reallocate(sizeof(chunk_t) + s, c);
+            c->size = s;
+            return c + 1;
+        }
+        if (c->arena->extend(c, s))
+        {
+            return p;
+        }
+        void* q = allocate(s);
+        memcpy(q, p, c->size < s? c->size: s);
+        c->arena->release(c);
+        return q;
+    }
+
+    static void deallocate(void* p)
+    {
+        if (p)
+        {
+            chunk_t* c = (chunk_t*)p - 1;
+            if (c->arena)
+            {
+                c->arena->release(c);
+            }
+            else
+            {
+                MEM::deallocate(c);
+            }
+        }
+    }
+};
+
 template <class MEM> struct _set_t
 {
     word_t* _dat;
@@ -193,7 +405,7 @@ template <class MEM> struct _set_t
         return _dat == NULL;
     }
 
-    void merge(const _set_t<MEM>& another)
+    template <class M> void merge(const _set_t<M>& another)
     {
         if (_cap >= another._cap)
         {
@@ -220,7 +432,44 @@ template <class MEM> struct _set_t
             }
             return p == e;
         }
-        return false;
+        else
+        {
+            // 容量不同时, 多出的部分必须全为0
+            const _set_t<MEM>* x = _cap > another->_cap? this: another;
+            const _set_t<MEM>* y = _cap > another->_cap? another: this;
+            for (size_t i = y->_cap; i < x->_cap; i++)
+            {
+                if (x->_dat[i])
+                {
+                    return false;
+                }
+            }
+            for (size_t i = 0; i < y->_cap; i++)
+            {
+                if (x->_dat[i] != y->_dat[i])
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+
+    // 末尾的0字不参与计算, 与equal的语义一致
+    size_t hash_code() const
+    {
+        const word_t* p = _dat;
+        const word_t* e = _dat + _cap;
+        size_t h = 0;
+        while (e != p && !*(e - 1))
+        {
+            e--;
+        }
+        while (p != e)
+        {
+            h ^= size_t(*p++) + 0x9e3779b9 + (h << 6) + (h >> 2);
+        }
+        return h;
     }
 
 #if __GNUC__ > 3
@@ -270,7 +519,7 @@ template <class MEM> struct _set_t
         _dat[x >> X] |= A >> (x & Y);
     }
 
-    void __merge(const _set_t<MEM>& another)
+    template <class M> void __merge(const _set_t<M>& another)
     {
         word_t* p = _dat;
         word_t* q = another._dat;
@@ -333,7 +582,7 @@ template <class MEM> struct _char_set_t
         MEM::deallocate(p);
     }
 
-    void copy(const _char_set_t<MEM>* another)
+    template <class M> void copy(const _char_set_t<M>* another)
     {
         *((U64*)_dat + 0) = *((U64*)another->_dat + 0);
         *((U64*)_dat + 1) = *((U64*)another->_dat + 1);
@@ -364,9 +613,9 @@ template <class MEM> struct _char_set_t
 
     void add_range(unsigned char a, unsigned char b)
     {
-        for (unsigned char x = a; x <= b; x++)
+        for (unsigned int x = a; x <= b; x++)
         {
-            add(x);
+            add((unsigned char)x);
         }
     }
 
@@ -385,10 +634,14 @@ template <class MEM> struct _char_set_t
 
     void ignore_case()
     {
-        U32* AZ = (U32*)_dat + 3;
-        U32* az = (U32*)_dat + 4;
-        *AZ |= *az & 0x7FFFFFE0;
-        *az |= *AZ & 0x7FFFFFE0;
+        for (unsigned char c = 'A'; c <= 'Z'; c++)
+        {
+            if (has(c) || has(c | 0x20))
+            {
+                add(c);
+                add(c | 0x20);
+            }
+        }
     }
 
 #if __GNUC__ > 3
@@ -683,8 +936,9 @@ template <class MEM> struct _exp_item_t
         char_set_t* charset;
         struct {unsigned int a, b;};
     };
+    unsigned int lo, hi;  // 单个字符或字符集的计数重复X{lo,hi}, hi为0时不是计数结点
 
-    _exp_item_t(item_type_t _type_): type(_type_)
+    _exp_item_t(item_type_t _type_): type(_type_), lo(0), hi(0)
     {
         switch (type)
         {
@@ -722,28 +976,28 @@ template <class MEM> struct _exp_item_t
         }
     }
 
-    _exp_item_t(char _ch_): type(CHAR)
+    _exp_item_t(char _ch_): type(CHAR), lo(0), hi(0)
     {
         ch = _ch_;
     }
 
-    _exp_item_t(item_type_t _type_, char _ch_): type(_type_)
+    _exp_item_t(item_type_t _type_, char _ch_): type(_type_), lo(0), hi(0)
     {
         ch = _ch_;
     }
 
-    _exp_item_t(char_set_t* _charset_): type(SET)
+    _exp_item_t(char_set_t* _charset_): type(SET), lo(0), hi(0)
     {
         charset = _charset_;
     }
 
-    _exp_item_t(unsigned int _a_, unsigned int _b_): type(RNG)
+    _exp_item_t(unsigned int _a_, unsigned int _b_): type(RNG), lo(0), hi(0)
     {
         a = _a_;
         b = _b_;
     }
 
-    _exp_item_t(const _exp_item_t<MEM>& another): type(another.type)
+    _exp_item_t(const _exp_item_t<MEM>& another): type(another.type), lo(another.lo), hi(another.hi)
     {
         if (is_set())
         {
@@ -789,8 +1043,9 @@ template <class MEM> struct _node_t
     item_type_t type;
     bool nul;
     position_t pos;
+    unsigned int lo, hi;  // 计数结点占用pos起的hi个位置, 第k个表示已读入k+1次, 共用一个follow
 
-    _node_t(_exp_item_t<MEM>* item): r(NULL), l(NULL), type(item->type), nul(false)
+    _node_t(_exp_item_t<MEM>* item): r(NULL), l(NULL), type(item->type), nul(false), pos(NOPOS), lo(item->lo), hi(item->hi)
     {
         if (type <= ECHAR)
         {
@@ -802,12 +1057,13 @@ template <class MEM> struct _node_t
         }
     }
 
-    _node_t(item_type_t t): r(NULL), l(NULL), type(t), nul(false)
+    _node_t(item_type_t t): r(NULL), l(NULL), type(t), nul(false), pos(NOPOS), lo(0), hi(0)
     {}
 
     _node_t(const _node_t& another):
         first(another.first), last(another.last), follow(another.follow), charset(another.charset),
-        r(another.r), l(another.l), type(another.type), nul(another.nul), pos(another.pos)
+        r(another.r), l(another.l), type(another.type), nul(another.nul), pos(another.pos),
+        lo(another.lo), hi(another.hi)
     {}
 
     int has(unsigned char x)
@@ -825,13 +1081,28 @@ template <class MEM> struct _APE_t
     typedef stack_t<item_type_t, MEM> opt_stack_t;
     typedef array_t<node_t, MEM> nodes_t;
     typedef array_t<node_t*, MEM> pos_nodes_t;
+    typedef array_t<position_t, MEM> positions_t;
+
+    // 捕获分组: 第id个左括号对应的子表达式以_nodes[node]为根
+    struct _group_t
+    {
+        size_t node;
+        unsigned int id;
+
+        _group_t(size_t x, unsigned int y): node(x), id(y)
+        {}
+    };
 
     const char* _exp;
     size_t _explen;
     exp_items_t* _items;
     nodes_t _nodes;
     pos_nodes_t posnodes;
+    positions_t receptions;  // 各表达式OK节点的位置, 单个表达式时只有reception_pos()
+    array_t<_group_t, MEM> groups;  // 按右括号的顺序, 重复展开的分组有多个根
+    unsigned int ngroups;
     opt_stack_t stack;
+    stack_t<unsigned int, MEM> _lpids;  // 未配对的左括号的分组号, 展开时加的括号为0
     error_t _en;
     position_t _pos;
 
@@ -845,7 +1116,7 @@ template <class MEM> struct _APE_t
 
     _APE_t(const char* exp, size_t explen):
         _exp(exp), _explen(explen),
-        _items(NULL), _en(NO_ERR), _pos(0),
+        _items(NULL), ngroups(0), _en(NO_ERR), _pos(0),
         _bor(false), _bstar(false), _bplus(false), _bqust(false),
         matchbegin(false), matchend(false)
     {}
@@ -874,11 +1145,77 @@ template <class MEM> struct _APE_t
             node_t* pnode = &_nodes.last();
             pnode->pos = _pos;
             posnodes.append(pnode);
+            receptions.append(_pos);
             _nodes.append(CAT);
         }
         return _en;
     }
 
+    /*
+     * 将n个表达式解析为 (e0 OK0)|(e1 OK1)|... 的形式, 每个表达式有自己的OK位置,
+     * 最后一个OK的位置即reception_pos(); 不支持^和$
+     */
+    error_t parse_union(const char* const* exps, const size_t* lens, size_t n)
+    {
+        array_t<exp_items_t*, MEM> lists;
+        size_t total = 0, i;
+
+        if (!n)
+        {
+            _en = ERR_EMP;
+        }
+        for (i = 0; i < n && _en == NO_ERR; i++)
+        {
+            _exp = exps[i];
+            _explen = lens[i];
+            if (__preprocess() == NO_ERR)
+            {
+                if (matchbegin || matchend)
+                {
+                    _en = NOT_SUPPORT;
+                }
+                total += _items->size();
+                lists.append(_items);
+                _items = NULL;
+            }
+        }
+        if (_en == NO_ERR)
+        {
+            _nodes.reserve(total + 3 * n);
+            for (i = 0; i < n; i++)
+            {
+                for (exp_item_t* item = lists[i]->begin(); item != lists[i]->end(); item++)
+                {
+                    __add_node(item);
+                }
+                while (!stack.empty())
+                {
+                    _nodes.append(stack.top());
+                    stack.pop();
+                }
+                _nodes.append(OK);
+                node_t* pnode = &_nodes.last();
+                pnode->pos = _pos;
+                posnodes.append(pnode);
+                receptions.append(_pos);
+                _nodes.append(CAT);
+                if (i)
+                {
+                    _nodes.append(OR);
+                }
+                if (i + 1 != n)
+                {
+                    _pos++;
+                }
+            }
+        }
+        for (exp_items_t** p = lists.begin(); p != lists.end(); p++)
+        {
+            exp_items_t::release(*p);
+        }
+        return _en;
+    }
+
     node_t* node_at_pos(position_t pos)
     {
         return posnodes[pos];
@@ -924,13 +1261,24 @@ template <class MEM> struct _APE_t
             if (type <= SET)
             {
                 node_t* pnode = &_nodes.last();
-                pnode->pos = _pos++;
-                posnodes.append(pnode);
+                size_t n = item->hi? item->hi: 1;
+                if (__exp0(_pos + n > MAX_POSITIONS))
+                {
+                    _en = ERR_TOO_MUCH_POSITIONS;
+                    return;
+                }
+                pnode->pos = _pos;
+                _pos += (position_t)n;
+                while (n--)
+                {
+                    posnodes.append(pnode);
+                }
             }
         }
         else if (type == LP)
         {
             stack.push(LP);
+            _lpids.push(item->a);
         }
         else if (type <= CAT)
         {
@@ -949,6 +1297,11 @@ template <class MEM> struct _APE_t
                 stack.pop();
             }
             stack.pop();
+            if (_lpids.top())
+            {
+                groups.append(_group_t(_nodes.size() - 1, _lpids.top()));
+            }
+            _lpids.pop();
         }
     }
 
@@ -990,6 +1343,7 @@ template <class MEM> struct _APE_t
                     if (notSET)
                     {
                         tmp.append(LP);
+                        tmp.last().a = ++ngroups;
                     }
                     else
                     {
@@ -1188,46 +1542,79 @@ template <class MEM> struct _APE_t
         }
         else
         {
-            _items = exp_items_t::create(); 
-            exp_item_t *x = items->begin(), *y = x, *z;
-
-            while (x != items->end())
+            /*
+             * 单个字符或字符集的X{a,b}记为计数结点, 不再展开; X{a,}记为X{a-1,a-1}X+;
+             * 括号的重复仍按文本展开, 在已输出的_items中找操作数, 因此可以嵌套
+             */
+            _items = exp_items_t::create();
+            for (exp_item_t* x = items->begin(); x != items->end(); x++)
             {
-                if (y->type == RNG)
+                if (x->type != RNG)
+                {
+                    _items->append(*x);
+                    continue;
+                }
+                if (_items->empty())
                 {
                     GOTO_ERR(ERR_RNG);
                 }
-                else if (x->type == RNG)
+                exp_item_t* z = &_items->last();
+                if (z->type == RP)
                 {
-                    if ((x - 1)->type == RP)
-                    {
-                        if (!(z = __get_matched_LP(y, x - 1)))
-                        {
-                            GOTO_ERR(ERR_RNG_NESTED);
-                        }
-                    }
-                    else
-                    {
-                        z = x - 1;
-                    }
-                    exp_items_t* exprng = __expand_rng(z, x, x->a, x->b);
-                    _items->append(y, z);
-                    if (!exprng->empty())
+                    z = __get_matched_LP(_items->begin(), z);
+                }
+                a = x->a;
+                b = x->b;
+                if (z->type <= SET && b != (unsigned int)-1 && b > 1)
+                {
+                    z->lo = a;
+                    z->hi = b;
+                    continue;
+                }
+                if (z->type <= SET && b == (unsigned int)-1 && a > 1)
+                {
+                    exp_item_t item(*z);
+                    if (a > 2)
                     {
-                        _items->append(LP);
-                        _items->append(exprng);
-                        _items->append(RP);
+                        z->lo = z->hi = a - 1;
                     }
-                    exp_items_t::release(exprng);
+                    _items->append(CAT);
+                    _items->append(item);
+                    _items->append(PLUS);
+                    continue;
+                }
+                size_t w = __count_positions(z, _items->end());
+                if (w * (b == (unsigned int)-1? a + 1: b) > MAX_POSITIONS)
+                {
+                    GOTO_ERR(ERR_TOO_MUCH_POSITIONS);
+                }
+                exp_items_t* exprng = __expand_rng(z, _items->end(), a, b);
+                while (_items->end() != z)
+                {
+                    _items->pop_back();
+                }
+                if (!exprng->empty())
+                {
+                    _items->append(LP);
+                    _items->last().a = 0;
+                    _items->append(exprng);
+                    _items->append(RP);
+                }
+                else if (_items->not_empty() && _items->last().type == CAT)
+                {
+                    _items->pop_back();  // X{0}只匹配空串, 连同前面的连接一起去掉
+                }
+                else if (x + 1 != items->end() && (x + 1)->type == CAT)
+                {
                     x++;
-                    y = x;
                 }
                 else
                 {
-                    x++;
+                    exp_items_t::release(exprng);
+                    GOTO_ERR(ERR_RNG);  // 不支持空的分支, 如a|b{0}
                 }
+                exp_items_t::release(exprng);
             }
-            _items->append(y, x);
             exp_items_t::release(items);
         }
         return NO_ERR;
@@ -1432,6 +1819,19 @@ template <class MEM> struct _APE_t
         return NULL;
     }
 
+    static size_t __count_positions(const exp_item_t* p, const exp_item_t* e)
+    {
+        size_t n = 0;
+        for (; p != e; p++)
+        {
+            if (p->type <= SET)
+            {
+                n += p->hi? p->hi: 1;
+            }
+        }
+        return n;
+    }
+
     exp_items_t* __expand_rng(exp_item_t* p, exp_item_t* e, int a, int b)
     {
         exp_items_t* res = exp_items_t::create();
@@ -1566,6 +1966,125 @@ template <class MEM> struct _APE_t
     }
 };
 
+/*
+ * 子表达式的字面串信息: exact表示只能匹配唯一的串(此时pre, suf, must都等于该串),
+ * 否则pre为所有匹配的公共前缀, suf为公共后缀, must为所有匹配都包含的串.
+ * 各串最多保留CAP个字节, 截断后仍然成立
+ */
+struct _literal_info_t
+{
+    static const size_t CAP = 64;
+
+    struct literal_t
+    {
+        unsigned char s[CAP];
+        size_t len;
+    };
+
+    bool exact;
+    literal_t pre, suf, must;
+
+    void clear()
+    {
+        exact = false;
+        pre.len = suf.len = must.len = 0;
+    }
+
+    void set(const unsigned char* s, size_t len)
+    {
+        exact = true;
+        if ((pre.len = len))
+        {
+            memcpy(pre.s, s, len);
+        }
+        suf = must = pre;
+    }
+
+    void cat(const _literal_info_t& l, const _literal_info_t& r)
+    {
+        if (l.exact && r.exact && l.pre.len + r.pre.len <= CAP)
+        {
+            exact = true;
+            __cat_head(pre, l.pre, r.pre);
+            suf = must = pre;
+            return;
+        }
+        literal_t t;
+        exact = false;
+        if (l.exact)
+        {
+            __cat_head(pre, l.pre, r.pre);
+        }
+        else
+        {
+            pre = l.pre;
+        }
+        if (r.exact)
+        {
+            __cat_tail(suf, l.suf, r.suf);
+        }
+        else
+        {
+            suf = r.suf;
+        }
+        __cat_head(t, l.suf, r.pre);
+        must = l.must;
+        __better(must, r.must);
+        __better(must, t);
+        __better(must, pre);
+        __better(must, suf);
+    }
+
+    void alt(const _literal_info_t& l, const _literal_info_t& r)
+    {
+        if (l.exact && r.exact && l.pre.len == r.pre.len && !memcmp(l.pre.s, r.pre.s, l.pre.len))
+        {
+            *this = l;
+            return;
+        }
+        exact = false;
+        pre.len = 0;
+        while (pre.len < l.pre.len && pre.len < r.pre.len && l.pre.s[pre.len] == r.pre.s[pre.len])
+        {
+            pre.s[pre.len] = l.pre.s[pre.len];
+            pre.len++;
+        }
+        suf.len = 0;
+        while (suf.len < l.suf.len && suf.len < r.suf.len &&
+            l.suf.s[l.suf.len - suf.len - 1] == r.suf.s[r.suf.len - suf.len - 1])
+        {
+            suf.len++;
+        }
+        memcpy(suf.s, l.suf.s + l.suf.len - suf.len, suf.len);
+        must = pre;
+        __better(must, suf);
+    }
+
+    static void __cat_head(literal_t& r, const literal_t& a, const literal_t& b)
+    {
+        size_t n = b.len < CAP - a.len? b.len: CAP - a.len;
+        memcpy(r.s, a.s, a.len);
+        memcpy(r.s + a.len, b.s, n);
+        r.len = a.len + n;
+    }
+
+    static void __cat_tail(literal_t& r, const literal_t& a, const literal_t& b)
+    {
+        size_t n = a.len < CAP - b.len? a.len: CAP - b.len;
+        memcpy(r.s, a.s + a.len - n, n);
+        memcpy(r.s + n, b.s, b.len);
+        r.len = n + b.len;
+    }
+
+    static void __better(literal_t& r, const literal_t& a)
+    {
+        if (a.len > r.len)
+        {
+            r = a;
+        }
+    }
+};
+
 template <class MEM> struct _tree_t: public _APE_t<MEM>
 {
 protected:
@@ -1590,21 +2109,176 @@ public:
         return this->_en;
     }
 
-    void ignore_case()
+    error_t build_union(const char* const* exps, const size_t* lens, size_t n)
     {
-        for (node_t** i = this->posnodes.begin(); i != this->posnodes.end(); i++)
+        if (_APE_t<MEM>::parse_union(exps, lens, n) == NO_ERR)
         {
-            (*i)->charset.ignore_case();
+            if (__build())
+            {
+                __get_follow(root);
+            }
         }
+        return this->_en;
     }
 
-    void debug_follow(const _set_t<MEM>& follow) const
+    bool first_has(position_t pos) const
     {
-        if (follow.empty())
+        return root->first.has(pos);
+    }
+
+    /*
+     * pos之后可以出现的位置并入set. 计数结点X{lo,hi}的第k个位置可以走到第k+1个,
+     * 已读入不少于lo次时才能离开, 离开后的位置记在结点共用的follow中
+     */
+    template <class SET> void follow_into(SET& set, position_t pos)
+    {
+        node_t* node = this->node_at_pos(pos);
+        if (node->hi)
         {
-            printf("### empty");
-        }
-        else for (int j = 0; j <= follow.last(); j++)
+            size_t k = pos - node->pos;
+            if (k + 1 < node->hi)
+            {
+                set.add(pos + 1);
+            }
+            if (k + 1 < node->lo)
+            {
+                return;
+            }
+        }
+        set.merge(node->follow);
+    }
+
+    // 求每个匹配都必须包含的最长字面串, 返回其长度, buf至少_literal_info_t::CAP字节
+    size_t required_literal(unsigned char* buf)
+    {
+        stack_t<_literal_info_t, MEM> stack;
+        _literal_info_t x;
+        for (node_t* p = this->_nodes.begin(); p != this->_nodes.end(); p++)
+        {
+            item_type_t type = p->type;
+            if (type == OK)
+            {
+                x.set(NULL, 0);  // 只匹配空串
+            }
+            else if (type < OK)
+            {
+                int c = __single_char(p->charset);
+                if (c >= 0 && !p->hi)
+                {
+                    unsigned char ch = (unsigned char)c;
+                    x.set(&ch, 1);
+                }
+                else if (c >= 0 && p->lo)
+                {
+                    // c{lo,hi}: 至少有lo个c, lo == hi且不超过CAP时是确定的
+                    unsigned char s[_literal_info_t::CAP];
+                    size_t len = p->lo < _literal_info_t::CAP? p->lo: _literal_info_t::CAP;
+                    memset(s, c, len);
+                    x.set(s, len);
+                    x.exact = p->lo == p->hi && p->lo <= _literal_info_t::CAP;
+                }
+                else
+                {
+                    x.clear();
+                }
+            }
+            else if (type <= QUST)
+            {
+                x = stack.top();
+                stack.pop();
+                if (type == PLUS)
+                {
+                    x.exact = false;
+                }
+                else
+                {
+                    x.clear();
+                }
+            }
+            else
+            {
+                _literal_info_t r = stack.top();
+                stack.pop();
+                _literal_info_t l = stack.top();
+                stack.pop();
+                if (type == CAT)
+                {
+                    x.cat(l, r);
+                }
+                else
+                {
+                    x.alt(l, r);
+                }
+            }
+            stack.push(x);
+        }
+        if (stack.empty())
+        {
+            return 0;
+        }
+        x = stack.top();
+        memcpy(buf, x.must.s, x.must.len);
+        return x.must.len;
+    }
+
+    // 匹配的最大长度, 含有*或+时为UNBOUNDED
+    size_t max_length()
+    {
+        stack_t<size_t, MEM> stack;
+        size_t x;
+        for (node_t* p = this->_nodes.begin(); p != this->_nodes.end(); p++)
+        {
+            item_type_t type = p->type;
+            if (type <= OK)
+            {
+                x = type < OK? (p->hi? p->hi: 1): 0;
+            }
+            else if (type <= QUST)
+            {
+                x = stack.top();
+                stack.pop();
+                if (type != QUST && x)
+                {
+                    x = UNBOUNDED;
+                }
+            }
+            else
+            {
+                size_t r = stack.top();
+                stack.pop();
+                size_t l = stack.top();
+                stack.pop();
+                if (type == CAT)
+                {
+                    x = l == UNBOUNDED || r == UNBOUNDED? UNBOUNDED: l + r;
+                }
+                else
+                {
+                    x = l > r? l: r;
+                }
+            }
+            stack.push(x);
+        }
+        return stack.empty()? 0: stack.top();
+    }
+
+    // root的字符集是各位置的并, 也要扩展, compile按它枚举输入字节
+    void ignore_case()
+    {
+        for (node_t** i = this->posnodes.begin(); i != this->posnodes.end(); i++)
+        {
+            (*i)->charset.ignore_case();
+        }
+        root->charset.ignore_case();
+    }
+
+    void debug_follow(const _set_t<MEM>& follow) const
+    {
+        if (follow.empty())
+        {
+            printf("### empty");
+        }
+        else for (int j = 0; j <= follow.last(); j++)
         {
             if (follow.has(j))
             {
@@ -1636,6 +2310,10 @@ public:
                     case OK:      printf("OK\t%d\t\t",  pos); break;
                     default:      printf("%c\t%d\t\t", i->charset.first(), pos);
                 }
+                if (i->hi)
+                {
+                    printf("{%u,%u} ", i->lo, i->hi);
+                }
                 debug_follow(follow);
                 printf("\n");
             }
@@ -1673,6 +2351,23 @@ public:
     }
 
 protected:
+    static int __single_char(const _char_set_t<MEM>& charset)
+    {
+        int r = -1;
+        for (int c = 0; c < 256; c++)
+        {
+            if (charset.has(c))
+            {
+                if (r >= 0)
+                {
+                    return -1;
+                }
+                r = c;
+            }
+        }
+        return r;
+    }
+
     int __build()
     {
         node_t *r, *l;
@@ -1684,7 +2379,20 @@ protected:
             {
                 _node_stack.push(p);
                 p->first.add(p->pos);
-                p->last.add(p->pos);
+                if (!p->hi)
+                {
+                    p->last.add(p->pos);
+                }
+                else
+                {
+                    // 读入lo次到hi次都可以离开, 从大到小加入只需扩容一次
+                    size_t k = p->hi, m = p->lo? p->lo - 1: 0;
+                    while (k > m)
+                    {
+                        p->last.add(p->pos + --k);
+                    }
+                    p->nul = !p->lo;
+                }
             }
             else if (type <= QUST)
             {
@@ -1733,32 +2441,31 @@ protected:
         return 1;    
     }
 
-    void __get_follow_cat(node_t* p)
+    // last中各位置的follow并入first, 计数结点的各位置是连续的且共用follow, 只需并一次
+    void __merge_follow(const typename node_t::pos_set_t& last, const typename node_t::pos_set_t& first)
     {
-        int pos = p->l->last.first();
-        int lastpos = p->l->last.last();
+        node_t* done = NULL;
+        int pos = last.first();
+        int lastpos = last.last();
         while (pos <= lastpos)
         {
-            if (p->l->last.has(pos))
+            if (last.has(pos) && this->node_at_pos(pos) != done)
             {
-                this->node_at_pos(pos)->follow.merge(p->r->first);
+                done = this->node_at_pos(pos);
+                done->follow.merge(first);
             }
             pos++;
         }
     }
 
+    void __get_follow_cat(node_t* p)
+    {
+        __merge_follow(p->l->last, p->r->first);
+    }
+
     void __get_follow_star(node_t* p)
     {
-        int pos = p->r->last.first();
-        int lastpos = p->r->last.last();
-        while (pos <= lastpos)
-        {
-            if (p->r->last.has(pos))
-            {
-                this->node_at_pos(pos)->follow.merge(p->r->first);
-            }
-            pos++;
-        }
+        __merge_follow(p->r->last, p->r->first);
     }
 
     void __get_follow_plus(node_t* p)
@@ -1801,14 +2508,20 @@ struct _delta_t
 template <class MEM> struct _state_t: public _set_t<MEM>
 {
     array_t<_delta_t, MEM> deltas;
+    size_t hash;  // 位置集合的散列值, 由rehash()计算
     id_t id;
     bool ok;
     input_t min;
     input_t max;
 
-    _state_t(size_t n = 0): id(n), ok(false), min(0xff), max(0)
+    _state_t(size_t n = 0): hash(0), id(n), ok(false), min(0xff), max(0)
     {}
 
+    void rehash()
+    {
+        hash = this->hash_code();
+    }
+
     static _state_t* create(size_t n = 0)
     {
         _state_t* p = (_state_t*)MEM::allocate(sizeof(_state_t));
@@ -1839,999 +2552,6628 @@ template <class MEM> struct _state_t: public _set_t<MEM>
     }
 };
 
-struct _result_t
+/*
+ * 子集构造时按位置集合查找已有状态的开放寻址散列表,
+ * 只保存指针, 不负责释放状态
+ */
+template <class MEM> struct _state_index_t
 {
-    const unsigned char* p;
-    const unsigned char* e;
+    typedef _state_t<MEM> state_t;
 
-    _result_t(const unsigned char* x, const unsigned char* y): p(x), e(y)
-    {}
+    state_t** _slots;
+    size_t _mask;
+    size_t _size;
 
-    std::string to_string()
+    _state_index_t(): _slots(NULL), _mask(0), _size(0)
     {
-        return std::string((const char*)p, (const char*)e);
+        __rehash(64);
     }
 
-    std::string& to_string(std::string& str)
+    ~_state_index_t()
     {
-        str.assign((const char*)p, (const char*)e);
-        return str;
+        MEM::deallocate(_slots);
+        _slots = NULL;
     }
-};
 
-template <class MEM> struct _results_t: public array_t<_result_t, MEM>
-{
-    const unsigned char* next_begin() const
+    state_t* find(state_t* aim) const
     {
-        return this->last().e;
+        size_t i = aim->hash & _mask;
+        while (_slots[i])
+        {
+            if (_slots[i]->hash == aim->hash && _slots[i]->equal(aim))
+            {
+                return _slots[i];
+            }
+            i = (i + 1) & _mask;
+        }
+        return NULL;
     }
-};
 
-template <class MEM> struct _state_table_t
-{
-    struct _item_t
+    void clear()
     {
-        unsigned short* ptr;
-        unsigned char min;
-        unsigned char max;
-
-        _item_t(unsigned short* _ptr_, unsigned char _min_, unsigned char _max_):
-            ptr(_ptr_), min(_min_), max(_max_)
-        {}
-    };
-
-    typedef _state_t<MEM> state_t;
-    typedef array_t<_item_t, MEM> table_t;
-
-    table_t _table;
-
-    _state_table_t()
-    {}
+        memset(_slots, 0, (_mask + 1) * sizeof(state_t*));
+        _size = 0;
+    }
 
-    ~_state_table_t()
+    void add(state_t* s)
     {
-        for (_item_t* i = _table.begin(); i != _table.end(); i++)
+        if (__exp0((_size + 1) << 1 > _mask + 1))
         {
-            MEM::deallocate(i->ptr);
+            __rehash((_mask + 1) << 1);
         }
+        __add(s);
+        _size++;
     }
 
-    void add(state_t* s)
+    void __add(state_t* s)
     {
-        unsigned char min = s->min;
-        unsigned char max = s->max;
-        unsigned short len = max - min + 1;
-        unsigned short* ptr = (unsigned short*)MEM::allocate(len * sizeof(unsigned short));
-        memset(ptr, 0xff, len);
-        for (_delta_t* p = s->deltas.begin(); p != s->deltas.end(); p++)
+        size_t i = s->hash & _mask;
+        while (_slots[i])
         {
-            ptr[p->input - min] = p->id;
+            i = (i + 1) & _mask;
         }
-        _table.append(_item_t(ptr, min, max));
+        _slots[i] = s;
     }
 
-    id_t trans(id_t id, input_t i)
+    void __rehash(size_t cap)
     {
-        _item_t* p = _table._dat + id;
-        if (i >= p->min && i <= p->max)
+        state_t** old = _slots;
+        size_t oldcap = old? _mask + 1: 0;
+        _slots = (state_t**)MEM::allocate(cap * sizeof(state_t*));
+        memset(_slots, 0, cap * sizeof(state_t*));
+        _mask = cap - 1;
+        for (size_t i = 0; i < oldcap; i++)
         {
-            return p->ptr[i - p->min];
+            if (old[i])
+            {
+                __add(old[i]);
+            }
         }
-        return 0xff;
+        MEM::deallocate(old);
     }
+};
 
-    static _state_table_t* create()
-    {
-        _state_table_t* p = (_state_table_t*)MEM::allocate(sizeof(_state_table_t));
-        ::new (p) _state_table_t();
-        return p;
-    }
+/*
+ * 从_tree_t中抽取的位置自动机(Glushkov), 只保留各位置的字符集与follow集,
+ * 不依赖语法树, 可以在compile结束后继续使用
+ */
+template <class MEM> struct _nfa_t
+{
+    typedef _set_t<MEM> pos_set_t;
+    typedef _char_set_t<MEM> char_set_t;
 
-    static void release(_state_table_t* p)
+    /*
+     * 计数结点展开成的一串位置只在一处保存follow: next是串内隐含的下一个位置,
+     * share是使用哪个位置的follow, 还不能离开计数结点时为NOPOS
+     */
+    struct _position_t
     {
-        MEM::deallocate(p);
-    }
-};
+        char_set_t charset;
+        pos_set_t follow;
+        position_t next;
+        position_t share;
 
-template <class MEM> struct re_t
-{
-    typedef _tree_t<MEM> tree_t;
-    typedef _state_t<MEM> state_t;
-    typedef array_t<state_t*, MEM> state_array_t;
-    typedef typename state_array_t::iterator_t state_iterator_t;
-    typedef stack_t<state_t*, MEM> state_stack_t;
-    typedef array_t<_delta_t, MEM> delta_array_t;
-    typedef _results_t<MEM> results_t;
-    typedef const unsigned char* (re_t::*match_fun_ptr)(const unsigned char*, const unsigned char*);
-    typedef int (re_t::*search_fun_ptr)(const unsigned char*, const unsigned char*, results_t&, long);
-    typedef const unsigned char* (re_t::*search_prefix_fun_ptr)(const unsigned char*, const unsigned char*);
-    typedef typename _results_t<MEM>::iterator_t result_iterator_t;
-    typedef typename _results_t<MEM>::const_iterator_t const_result_iterator_t;
+        _position_t(position_t self): next(NOPOS), share(self)
+        {}
 
-    char* _exp;
-    size_t _explen;
-    size_t _num;
-    bool* _accept;
-    unsigned char* _trans;
-    unsigned char* _prefix;
-    size_t _prelen;
-    unsigned char* _pretable;
-    match_fun_ptr _match_fun;
-    search_fun_ptr _search_fun;
-    search_prefix_fun_ptr _search_prefix_fun;
+        int has(unsigned char x) const
+        {
+            return charset.has(x);
+        }
+    };
 
-    bool _ignorecase, _matchword, _badcharopt;
-    bool matchbegin, matchend, matchmin;
-    unsigned char _cmin, _cmax;
+    array_t<_position_t, MEM> positions;
+    pos_set_t first;
+    position_t reception;
 
-    re_t()
-    {
-        memset(this, 0, sizeof(re_t));
-    }
+    _nfa_t(): reception(0)
+    {}
 
-    re_t(const char* exp, long flag = 0)
+    static _nfa_t* create()
     {
-        memset(this, 0, sizeof(re_t));
-        if (exp)
-        {
-            __set_exp(exp, strlen(exp), flag);
-        }
+        _nfa_t* p = (_nfa_t*)MEM::allocate(sizeof(_nfa_t));
+        ::new (p) _nfa_t();
+        return p;
     }
 
-    re_t(const char* exp, size_t explen, long flag = 0)
+    static void release(_nfa_t* p)
     {
-        memset(this, 0, sizeof(re_t));
-        if (exp)
+        if (p)
         {
-            __set_exp(exp, explen, flag);
+            p->~_nfa_t();
+            MEM::deallocate(p);
         }
     }
 
-    re_t(const re_t& another)  // 待实现
-    {}
-
-    ~re_t()
+    template <class M> void build(_tree_t<M>& tree)
     {
-        release();
+        __copy_positions(tree);
+        first.merge(tree.root->first);
     }
 
-    error_t compile()
+    /*
+     * 在末尾增加一个匹配任意字节的位置, 它跟随自己和first, 相当于在表达式前加上.*,
+     * 从任意位置开始的匹配都在一遍扫描中进行, 状态中出现reception即有匹配在此结束
+     */
+    template <class M> void build_unanchored(_tree_t<M>& tree)
     {
-        tree_t tree(_exp, _explen);
-        error_t ret = tree.build();
-
-        if (ret == NO_ERR)
+        __copy_positions(tree);
+        _position_t pos(reception + 1);
+        pos.charset.invert();
+        for (position_t i = 0; i < reception; i++)
         {
-            if (_ignorecase)
+            if (tree.root->first.has(i))
             {
-                tree.ignore_case();
+                pos.follow.add(i);  // reception除外, 空匹配不算
             }
-    #ifdef _RE_DEBUG
-            tree.debug();
-    #endif
-            matchbegin = tree.matchbegin;
-            matchend = tree.matchend;
-
-            state_t *start, *curstate;
-            state_stack_t stack;
-            state_array_t states;
-            state_array_t newstates;
-            delta_array_t newdelta;
-    
-            start = state_t::create();
-            start->merge(tree.root->first);
-            stack.push(start);
-    
-            _cmin = tree.root->charset.first();
-            _cmax = tree.root->charset.last();
-    
-            while (!stack.empty())
-            {
-                states.append(stack.top());
-                stack.pop();
-                curstate = states.last();
-    
-                /*
-                 * 对curstate输入范围为[cmin,cmax]的字符，
-                 * 将新生成的状态记录在newstates中，状态转移情况记录在newdelta中
-                 */
-                __generate_new_state(curstate, tree, newstates, newdelta);
-                __merge_and_add(curstate, newstates, newdelta, states, stack);
-            }
-            _num++;
-            __set_acceptions(states, tree);
-            __sort_states(states);
-            if (__deal_with_prefix(states))
+        }
+        pos.follow.add(reception + 1);
+        first.merge(pos.follow);
+        positions.append(pos);
+    }
+
+    /*
+     * 反向自动机: 位置不变, follow反转, 原表达式first中的位置可到达reception.
+     * unanchored为false时起始集合取全部位置而不只是原来的last, 从某处向左扫描时,
+     * 状态中出现reception表示从该处起的一段输入是某个匹配的前缀;
+     * unanchored为true时起始集合为原来的last, 另加一个匹配任意字节并跟随自己和last的位置,
+     * 从右端一直向左扫描, 在每处得到的状态即从该处出发能够走到某个匹配结尾的位置集合
+     */
+    template <class M> void build_reverse(_tree_t<M>& tree, bool unanchored)
+    {
+        reception = tree.reception_pos();
+        positions.reserve(reception + 2);
+        for (position_t i = 0; i <= reception; i++)
+        {
+            _position_t pos(i);
+            if (i < reception)
             {
-                _num = 0;  //??有用咩
-                _match_fun = &re_t::__match_sample;
-                _search_fun = &re_t::__search_sample;
+                _node_t<M>* node = tree.node_at_pos(i);
+                pos.charset.copy(&node->charset);
+                if (i != node->pos)
+                {
+                    // 计数结点反向后由后一个位置走到前一个, 只有第一个位置能离开
+                    pos.next = i - 1;
+                    pos.share = NOPOS;
+                }
             }
-            else
+            positions.append(pos);
+        }
+        _position_t loop(reception + 1);
+        loop.charset.invert();
+        for (position_t i = 0; i < reception; i++)
+        {
+            _node_t<M>* node = tree.node_at_pos(i);
+            const _set_t<M>& follow = node->follow;
+            bool out = size_t(i - node->pos) + 1 >= node->lo;  // 计数结点中已读够lo次才能离开
+            if (out)
             {
-                if (_num <= THR)
+                int j = follow.empty()? 0: follow.first();
+                int lastj = follow.empty()? -1: follow.last();
+                for (; j <= lastj && j < reception; j++)
                 {
-                    __generate_DFA_bthr(states, tree);
-                    if (_matchword)
-                    {
-                        _match_fun = &re_t::__match_word_bthr;
-                        _search_fun = &re_t::__search_word_bthr;
-                    }
-                    else
+                    if (follow.has(j))
                     {
-                        _match_fun = &re_t::__match_bthr;
-                        _search_fun = _prefix?
-                            &re_t:: __search_with_prefix_bthr:
-                            &re_t::__search_without_prefix_bthr;
-                    }
-                }
-                else
-                {
-                    __generate_DFA_athr(states, tree);
-                    if (_matchword)
-                    {
-                        _match_fun = &re_t::__match_word_athr;
-                        _search_fun = &re_t::__search_word_athr;
-                    }
-                    else
-                    {
-                        _match_fun = &re_t::__match_athr;
-                        _search_fun = _prefix?
-                            &re_t:: __search_with_prefix_athr:
-                            &re_t::__search_without_prefix_athr;
+                        positions[j].follow.add(i);
                     }
                 }
             }
-
-            for (state_iterator_t i = states.begin(); i != states.end(); i++)
+            if (tree.root->first.has(i))
             {
-    #ifdef _RE_DEBUG
-                __debug_state(i);
-    #endif
-                state_t::release(*i);
+                positions[i].follow.add(reception);
+            }
+            if (!unanchored)
+            {
+                first.add(i);
+            }
+            else if (out && follow.has(reception))
+            {
+                loop.follow.add(i);
             }
         }
-        return ret;
+        if (unanchored)
+        {
+            loop.follow.add(reception + 1);
+            first.merge(loop.follow);
+            positions.append(loop);
+        }
     }
 
-    error_t compile(const char* exp, size_t explen, long flag = 0)
+    const _position_t* node_at_pos(position_t pos) const
     {
-        release();
-        if (exp)
+        return positions._dat + pos;
+    }
+
+    template <class SET> void follow_into(SET& set, position_t pos) const
+    {
+        const _position_t& x = positions[pos];
+        if (x.next != NOPOS)
         {
-            __set_exp(exp, _explen = explen, flag);
-            return compile();
+            set.add(x.next);
+        }
+        if (x.share != NOPOS)
+        {
+            set.merge(positions[x.share].follow);
         }
-        return ERR_EMP;
     }
 
-    error_t compile(const char* exp, long flag = 0)
+    bool first_has(position_t pos) const
     {
-        return compile(exp, strlen(exp), flag);
+        return first.has(pos);
     }
 
-    const unsigned char* match(const unsigned char* p, const unsigned char* e)
+    position_t reception_pos() const
     {
-        return (this->*_match_fun)(p, e);
+        return reception;
     }
 
-    const char* match(const char* p, const char* e)
+    template <class M> void __copy_positions(_tree_t<M>& tree)
     {
-        return (const char*)(this->*_match_fun)((const unsigned char*)p, (const unsigned char*)e);
+        reception = tree.reception_pos();
+        positions.reserve(reception + 2);
+        for (position_t i = 0; i <= reception; i++)
+        {
+            _node_t<M>* node = tree.node_at_pos(i);
+            _position_t pos(i);
+            pos.charset.copy(&node->charset);
+            if (node->hi)
+            {
+                size_t k = i - node->pos;
+                pos.next = k + 1 < node->hi? i + 1: NOPOS;
+                pos.share = k + 1 < node->lo? NOPOS: node->pos;
+            }
+            if (i == node->pos)
+            {
+                pos.follow.merge(node->follow);
+            }
+            positions.append(pos);
+        }
     }
+};
 
-    const char* match(const char* p)
+/*
+ * 惰性DFA: 状态只在扫描首次到达时才由位置集合生成, 转移表按需填充,
+ * 占用内存超过_cap时清空全部缓存, 从起始状态重新开始.
+ * _nfa只读, 由_program_t所有, 复制的对象共用
+ */
+template <class MEM> struct _lazy_dfa_t
+{
+    typedef _nfa_t<MEM> nfa_t;
+    typedef _state_t<MEM> state_t;
+    typedef array_t<state_t*, MEM> state_array_t;
+    typedef _state_index_t<MEM> state_index_t;
+
+    static const U16 DEAD = 0xffff;
+    static const U16 UNKNOWN = 0xfffd;
+
+    const nfa_t* _nfa;
+    state_array_t _states;
+    state_index_t _index;
+    U16* _rows;
+    bool* _accept;
+    size_t _rowcap;
+    const unsigned char* _classes;
+    unsigned char _cshift;
+    size_t _cap;
+    size_t _used;
+    size_t _flushes;
+
+    _lazy_dfa_t(): _nfa(NULL), _rows(NULL), _accept(NULL), _rowcap(0), _classes(NULL), _cshift(0),
+        _cap(LAZY_CACHE_SIZE), _used(0), _flushes(0)
+    {}
+
+    ~_lazy_dfa_t()
     {
-        return (const char*)(this->*_match_fun)((const unsigned char*)p, (const unsigned char*)(p + strlen(p)));
+        __clear();
+        MEM::deallocate(_rows);
+        MEM::deallocate(_accept);
+        _rows = NULL;
+        _accept = NULL;
     }
 
-    size_t search(const unsigned char* p, const unsigned char* e, results_t& results, long n = SEARCH_FIRST)
+    static _lazy_dfa_t* create()
     {
-        size_t s0 = results.size();
-        __search(p, e, results, n);
-        return results.size() - s0;
+        _lazy_dfa_t* p = (_lazy_dfa_t*)MEM::allocate(sizeof(_lazy_dfa_t));
+        ::new (p) _lazy_dfa_t();
+        return p;
     }
 
-    size_t search(const char* p, const char* e, results_t& results, long n = SEARCH_FIRST)
+    static void release(_lazy_dfa_t* p)
     {
-        return search((const unsigned char*)p, (const unsigned char*)e, results, n);
+        if (p)
+        {
+            p->~_lazy_dfa_t();
+            MEM::deallocate(p);
+        }
     }
 
-    size_t search(const char* p, results_t& results, long n = SEARCH_FIRST)
+    // 与another共用_nfa, 状态缓存另起, 供其他线程使用
+    static _lazy_dfa_t* clone(const _lazy_dfa_t* another)
     {
-        return search((const unsigned char*)p, (const unsigned char*)(p + strlen(p)), results, n);
+        if (!another)
+        {
+            return NULL;
+        }
+        _lazy_dfa_t* p = create();
+        p->init(another->_nfa, another->_classes, another->_cshift, another->_cap);
+        return p;
     }
 
-    #define __memchr(p, ch, len) (const unsigned char*)memchr((p), (ch), (len))
+    void init(const nfa_t* nfa, const unsigned char* classes, unsigned char cshift, size_t cap)
+    {
+        _nfa = nfa;
+        _classes = classes;
+        _cshift = cshift;
+        _cap = cap;
+        __add_start();
+    }
 
-    static __must_inline(const unsigned char*) __find_linesep(const unsigned char* p, const unsigned char* e, unsigned char c0, unsigned char c1)
+    __must_inline(size_t) next(size_t s, unsigned char c)
     {
-        const unsigned char* q;
-        while ((q = __memchr(p, c0, e - p - 1)))
+        size_t t = _rows[(s << _cshift) + _classes[c]];
+        if (__exp0(t == UNKNOWN))
         {
-            if (*(q + 1) == c1)
-            {
-                return q;
-            }
-            p = ++q;
+            t = __compute(s, c);
         }
-        return NULL;
+        return t;
     }
 
-    size_t search_lines(const unsigned char* p, const unsigned char* e, results_t& results, long n = SEARCH_FIRST, const char* sep = "\n")
+    size_t __compute(size_t s, unsigned char c)
     {
-        size_t s0 = results.size(), s = s0;
-        const unsigned char* q;
-        if (__exp1(!*(sep + 1)))
+        state_t* cur = _states[s];
+        state_t* t = NULL;
+        state_t* found;
+        int pos = cur->first();
+        int lastpos = cur->last();
+        for (; pos <= lastpos; pos++)
         {
-            while (p < e && (q = __memchr(p, *sep, e - p)))
+            if (cur->has(pos) && _nfa->node_at_pos(pos)->has(c))
             {
-                if (__search(p, q, results, n) == RESULTS_ENOUGH) return n;
-                p = ++q;
-                n -= results.size() - s;
-                s = results.size();
+                if (!t)
+                {
+                    t = state_t::create();
+                }
+                _nfa->follow_into(*t, pos);
             }
         }
-        else if (!*(sep + 2))
+        if (!t)
         {
-            char c0 = *(sep + 0);
-            char c1 = *(sep + 1);
-            while (p < e && (q = __find_linesep(p, e, c0, c1)))
-            {
-                if (__search(p, q, results, n) == RESULTS_ENOUGH) return n;
-                p = q + 2;
-                n -= results.size() - s;
-                s = results.size();
-            }
+            _rows[(s << _cshift) + _classes[c]] = DEAD;
+            return DEAD;
         }
-        else
+        t->rehash();
+        if ((found = _index.find(t)))
         {
-            // ...
+            state_t::release(t);
+            _rows[(s << _cshift) + _classes[c]] = found->id;
+            return found->id;
         }
-        __search(p, e, results, n);
-        return results.size() - s0;
-    }
-
-    size_t search_lines(const char* p, const char* e, results_t& results, long n = SEARCH_FIRST, const char* sep = "\n")
-    {
-        return search_lines((const unsigned char*)p, (const unsigned char*)e, results, n, sep);
+        if (__exp0(_used + __cost(t) > _cap || _states.size() >= MAX_STATES))
+        {
+            // 缓存已满: 清空后只保留起始状态, 当前状态s随之失效
+            __clear();
+            _flushes++;
+            __add_start();
+            if ((found = _index.find(t)))
+            {
+                state_t::release(t);
+                return found->id;
+            }
+            return __add(t);
+        }
+        size_t id = __add(t);
+        _rows[(s << _cshift) + _classes[c]] = (U16)id;
+        return id;
     }
 
-    size_t search_lines(const char* p, results_t& results, long n = SEARCH_FIRST, const char* sep = "\n")
+    size_t __cost(state_t* t) const
     {
-        return search_lines((const unsigned char*)p, (const unsigned char*)(p + strlen(p)), results, n, sep);
+        return (sizeof(U16) << _cshift) + sizeof(bool) + sizeof(state_t) + t->_cap * sizeof(word_t) + 2 * sizeof(state_t*);
     }
 
-    bool accept_empty() const
+    size_t __add(state_t* t)
     {
-        return _accept[0];
+        size_t id = _states.size();
+        size_t width = (size_t)1 << _cshift;
+        if (id == _rowcap)
+        {
+            _rowcap = _rowcap? _rowcap << 1: 16;
+            _rows = (U16*)MEM::reallocate(_rowcap * width * sizeof(U16), _rows);
+            _accept = (bool*)MEM::reallocate(_rowcap * sizeof(bool), _accept);
+        }
+        U16* row = _rows + id * width;
+        for (size_t i = 0; i < width; i++)
+        {
+            row[i] = UNKNOWN;
+        }
+        t->id = (id_t)id;
+        t->ok = t->has(_nfa->reception_pos());
+        _accept[id] = t->ok;
+        _states.append(t);
+        _index.add(t);
+        _used += __cost(t);
+        return id;
     }
 
-    void release()
+    void __add_start()
     {
-        MEM::deallocate(_exp);
-        MEM::deallocate(_prefix);
-        MEM::deallocate(_pretable);
-        MEM::deallocate(_accept);
-        MEM::deallocate(_trans);
-        memset(this, 0, sizeof(re_t));
+        state_t* start = state_t::create();
+        start->merge(_nfa->first);
+        start->rehash();
+        __add(start);
     }
 
-    void __set_exp(const char* exp, size_t explen, long flag)
+    void __clear()
     {
-        _exp = (char*)MEM::allocate(_explen = explen);
-        memcpy(_exp, exp, _explen);
-        matchbegin = (flag & MATCH_BEGIN) != 0;
-        matchend = (flag & MATCH_END) != 0;
-        matchmin =  (flag & MATCH_MIN) != 0;
-        _matchword = (flag & MATCH_WORD) != 0;
-        _ignorecase = (flag & MATCH_ICASE) != 0; 
-        _badcharopt = (flag & BAD_CHAR_OPT) != 0;
+        for (state_t** i = _states.begin(); i != _states.end(); i++)
+        {
+            state_t::release(*i);
+        }
+        _states.clear();
+        _index.clear();
+        _used = 0;
     }
+};
 
-    void __generate_new_state(state_t* curstate, 
-                              tree_t& tree,
-                              state_array_t& newstates,
-                              delta_array_t& newdelta)
-    {
-        state_t* newstat;
-        state_iterator_t found;
-        int temp_statnum = 0;
+/*
+ * 位置(含reception)不超过64个时的位并行模拟, 状态是位置集合的位图, 位i即位置i.
+ * 读入c时先与chars[c]相与留下能读入c的位置, 再每8个位置一组查表求它们follow的并,
+ * 不需要子集构造, 每个字节的代价与DFA的状态数无关. 状态为0即不再有匹配
+ */
+struct _bit_nfa_t
+{
+    static const size_t MAX = 64;
 
-        newdelta.clear();
-        newstates.clear();
+    U64 chars[256];
+    U64 follow[MAX / 8][256];
+    U64 first;
+    U64 accept;
 
-        for (int c = _cmin; c <= _cmax; c++)
+    template <class NFA> void build(const NFA& nfa)
+    {
+        size_t n = nfa.positions.size();
+        U64 f[MAX];
+        memset(f, 0, sizeof(f));
+        memset(chars, 0, sizeof(chars));
+        memset(follow, 0, sizeof(follow));
+        for (size_t i = 0; i < n; i++)
         {
-            if ((newstat = __input_one_char(curstate, c, tree)))
+            typename NFA::pos_set_t s;
+            nfa.follow_into(s, (position_t)i);
+            f[i] = __bits(s, n);
+            for (int c = 0; c < 256; c++)
             {
-                if ((found = __find_state(newstates.begin(), newstates.end(), newstat)))
-                {
-                    newdelta.append(_delta_t(c, (*found)->id));
-                    state_t::release(newstat);
-                }
-                else
+                if (nfa.node_at_pos((position_t)i)->has(c))
                 {
-                    newstat->id = ++temp_statnum;
-                    newdelta.append(_delta_t(c, newstat->id));
-                    newstates.append(newstat);
+                    chars[c] |= (U64)1 << i;
                 }
             }
         }
-    }
-
-    void __merge_and_add(state_t* curstate,
-                         state_array_t& newstates,
-                         delta_array_t& newdelta,
-                         state_array_t& states,
-                         state_stack_t& stack)
-    {
-        state_iterator_t found, i;
-        for (i = newstates.begin(); i != newstates.end(); i++)
+        for (size_t g = 0; g < (n + 7) >> 3; g++)
         {
-            if ((found = __find_state(states.begin(), states.end(), *i)))
-            {
-                for (_delta_t* p = newdelta.begin(); p != newdelta.end(); p++)
-                {
-                    if (p->id == (*i)->id)
-                    {
-                        curstate->add_delta(p->input, (*found)->id);
-                    }
-                }
-                state_t::release(*i);
-            }
-            else
+            for (int b = 1; b < 256; b++)
             {
-                ++_num;
-                for (_delta_t* p = newdelta.begin(); p != newdelta.end(); p++)
+                int j = 0;
+                while (!(b >> j & 1))
                 {
-                    if (p->id == (*i)->id)
-                    {
-                        curstate->add_delta(p->input, _num);
-                    }
+                    j++;
                 }
-                (*i)->id = _num;
-                stack.push(*i);
+                follow[g][b] = follow[g][b & (b - 1)] | f[(g << 3) + j];
             }
         }
+        first = __bits(nfa.first, n);
+        accept = (U64)1 << nfa.reception_pos();
     }
 
-    void __set_acceptions(state_array_t& states, const tree_t& tree)
+    __must_inline(U64) next(U64 s, unsigned char c) const
     {
-        state_iterator_t i = states.begin();
-        while (i != states.end())
+        U64 x = s & chars[c], t = 0;
+        for (const U64 (*g)[256] = follow; x; g++, x >>= 8)
         {
-            if ((*i)->has(tree.reception_pos()))
-            {
-                (*i)->ok = true;
-            }
-            i++;
+            t |= (*g)[x & 0xff];
         }
+        return t;
     }
 
-    void __sort_states(state_array_t& states)
+    template <class SET> static U64 __bits(const SET& s, size_t n)
     {
-        if (states.size() > 1)
+        U64 r = 0;
+        for (size_t i = 0; i < n; i++)
         {
-            typename state_array_t::value_t tmp;
-            state_iterator_t i = states.begin() + 1, j;
-            while (i != states.end())
+            if (s.has(i))
             {
-                tmp = *i;
-                for (j = i++; j > states.begin() && (*(j - 1))->id > tmp->id; j--)
-                {
-                    *j = *(j - 1);
-                }
-                *j = tmp;
+                r |= (U64)1 << i;
             }
         }
+        return r;
     }
+};
 
-    void __generate_DFA_bthr(state_array_t& states, tree_t& tree)
+// 位置的稀疏集合, 清空是O(1)的, 加入按先后存于dense
+struct _sparse_set_t
+{
+    position_t* dense;
+    position_t* sparse;
+    size_t size;
+
+    bool has(position_t x) const
     {
-        size_t transize = _num << 8;
-        _trans = (unsigned char*)MEM::allocate(transize);
-        memset(_trans, 0xff, transize);
-        _accept = (bool*)MEM::allocate(_num * sizeof(bool));
-        for (state_iterator_t i = states.begin(); i != states.end(); i++)
+        size_t i = sparse[x];
+        return i < size && dense[i] == x;
+    }
+
+    void add(position_t x)
+    {
+        if (!has(x))
         {
-            id_t id = (*i)->id;
-            _accept[id] = (*i)->ok;
-            for (_delta_t* j = (*i)->deltas.begin(); j != (*i)->deltas.end(); j++)
-            {
-                _trans[(id << 8) + j->input] = (unsigned char)(j->id);
-            }
+            sparse[x] = (position_t)size;
+            dense[size++] = x;
         }
-        if (_badcharopt)
+    }
+};
+
+// _pike_vm_t模拟时的工作区, 每个re_t各有一份, 按需创建
+template <class MEM> struct _pike_run_t
+{
+    _sparse_set_t sets[2];
+    _sparse_set_t* cur;
+    _sparse_set_t* nxt;
+    U32* stamp;  // 计数结点共用的follow在这一步是否已经并入
+    U32 gen;
+    size_t cap;
+
+    static _pike_run_t* create(size_t n)
+    {
+        size_t head = (sizeof(_pike_run_t) + 15) & ~(size_t)15;
+        unsigned char* p = (unsigned char*)MEM::allocate(head + n * (4 * sizeof(position_t) + sizeof(U32)));
+        memset(p, 0, head + n * (4 * sizeof(position_t) + sizeof(U32)));
+        _pike_run_t* r = (_pike_run_t*)p;
+        r->stamp = (U32*)(p + head);
+        position_t* q = (position_t*)(r->stamp + n);
+        for (int i = 0; i < 2; i++)
         {
-            unsigned char c, *p = _trans + 256;
-            while (p < _trans + transize)
-            {
-                memset(p, 0xfe, _cmin);
-                for (c = _cmin + 1, p += c; c < _cmax; c++, p++)
-                {
-                    if (!tree.root->charset.has(c))
-                    {
-                        *p = 0xfe;
-                    }
-                }
-                memset(++p, 0xfe, 255 - _cmax);
-                p += 255 - _cmax;
-            }
+            r->sets[i].dense = q;
+            r->sets[i].sparse = q + n;
+            r->sets[i].size = 0;
+            q += 2 * n;
         }
+        r->cur = r->sets;
+        r->nxt = r->sets + 1;
+        r->gen = 0;
+        r->cap = n;
+        return r;
     }
 
-    void __generate_DFA_athr(state_array_t& states, tree_t& tree)
+    static void release(_pike_run_t* p)
     {
-        // ...
+        MEM::deallocate(p);
     }
+};
 
-    state_t* __input_one_char(state_t* stat, unsigned char c, tree_t& tree)
-    {
-        state_t* newstat = NULL;
-        int pos = stat->first();
-        int lastpos = stat->last();
-        while (pos <= lastpos)
+/*
+ * 位置自动机的直接模拟(Pike VM), 用于子集构造超出预算而位置又多于_bit_nfa_t能容纳的表达式.
+ * 状态是活跃位置的稀疏集合, 每读入一个字节把能读入它的位置的follow并入下一个集合,
+ * 内存只与位置数和follow的边数有关, 每字节的代价不超过边数. 计数结点的一串位置共用一份follow,
+ * 一步中只并入一次. 各表在一块内存中, 由_program_t释放
+ */
+template <class MEM> struct _pike_vm_t
+{
+    typedef _pike_run_t<MEM> run_t;
+
+    size_t num;           // 位置数
+    position_t reception;
+    size_t nfirst;
+    U32* chars;           // 各位置的字符集, 每个位置8个U32
+    position_t* next;     // 计数结点中隐含的下一个位置, 没有时为NOPOS
+    position_t* share;    // 使用哪个位置的follow, 还不能离开计数结点时为NOPOS
+    U32* offs;            // 位置i的follow为edges[offs[i], offs[i + 1])
+    position_t* edges;
+    position_t* first;
+    void* dat;
+
+    // 只取nfa的前n个位置, 后面的位置(如build_reverse的.*)不进入起始集合
+    template <class NFA> void build(const NFA& nfa, size_t n)
+    {
+        size_t m = 0, f = __count(nfa.first, n);
+        for (size_t i = 0; i < n; i++)
         {
-            if (stat->has(pos) && tree.node_at_pos(pos)->has(c))
+            m += __count(nfa.positions[i].follow, n);
+        }
+        size_t size = n * 8 * sizeof(U32) + (n + 1) * sizeof(U32) + (2 * n + m + f) * sizeof(position_t);
+        unsigned char* p = (unsigned char*)MEM::allocate(size);
+        memset(p, 0, size);
+        dat = p;
+        chars = (U32*)p;
+        offs = chars + n * 8;
+        next = (position_t*)(offs + n + 1);
+        share = next + n;
+        edges = share + n;
+        first = edges + m;
+        num = n;
+        reception = nfa.reception_pos();
+        nfirst = f;
+        m = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+            for (int c = 0; c < 256; c++)
             {
-                if (__exp0(newstat == NULL))    // 改成newstat != NULL的形式??
+                if (nfa.node_at_pos((position_t)i)->has(c))
                 {
-                    newstat = state_t::create();
+                    chars[(i << 3) + (c >> 5)] |= (U32)1 << (c & 31);
                 }
-                newstat->merge(tree.node_at_pos(pos)->follow);
             }
-            pos++;
+            next[i] = nfa.positions[i].next;
+            share[i] = nfa.positions[i].share;
+            offs[i] = (U32)m;
+            m += __list(nfa.positions[i].follow, n, edges + m);
         }
-        return newstat;
+        offs[n] = (U32)m;
+        __list(nfa.first, n, first);
     }
 
-    state_iterator_t __find_state(state_iterator_t i, state_iterator_t e, state_t* aim)
+    void clear()
+    {
+        MEM::deallocate(dat);
+        dat = NULL;
+    }
+
+    void start(run_t& r) const
     {
-        while (i != e && !(*i)->equal(aim))   // 代码有待推敲
+        r.cur->size = 0;
+        for (size_t i = 0; i < nfirst; i++)
         {
-            i++;
+            r.cur->add(first[i]);
         }
-        return cond_ptr(i, i != e);
     }
 
-    bool __deal_with_prefix(state_array_t& states)
+    // 读入c, 返回是否还有活跃的位置
+    bool step(run_t& r, unsigned char c) const
     {
-        if (__exp0(_matchword))
+        const _sparse_set_t& s = *r.cur;
+        _sparse_set_t& t = *r.nxt;
+        t.size = 0;
+        if (__exp0(!++r.gen))
+        {
+            memset(r.stamp, 0, r.cap * sizeof(U32));
+            r.gen = 1;
+        }
+        for (size_t i = 0; i < s.size; i++)
         {
-            _pretable = (unsigned char*)MEM::allocate(256);
-            memset(_pretable, 0, 256);
-            const unsigned char* p = (const unsigned char*)BOUND_CHARS;
-            while (*p)
+            position_t x = s.dense[i];
+            if (chars[(x << 3) + (c >> 5)] & ((U32)1 << (c & 31)))
             {
-                _pretable[*p++] = 1;
+                if (next[x] != NOPOS)
+                {
+                    t.add(next[x]);
+                }
+                position_t b = share[x];
+                if (b != NOPOS && r.stamp[b] != r.gen)
+                {
+                    r.stamp[b] = r.gen;
+                    for (U32 k = offs[b]; k < offs[b + 1]; k++)
+                    {
+                        t.add(edges[k]);
+                    }
+                }
             }
-            _pretable[0] = 1;  // '\0' is also a word boundary
-            return false;
         }
+        r.nxt = r.cur;
+        r.cur = &t;
+        return t.size != 0;
+    }
 
-        bool sample = false;
-        unsigned char buf[256];
-        id_t id = 0;
-        while (id < _num)
-        {
-            state_t* s = states[id];
-            if (s->deltas.size() != 1 || s->deltas.first().id != id + 1 || s->ok)
-            {
-                break;
-            }
-            buf[_prelen++] = s->deltas.first().input;
-            id++;
-        }
-        if (id == _num)
-        {
-            sample = true;
-        }
-        if (_prelen)
+    bool accepted(const run_t& r) const
+    {
+        return r.cur->has(reception);
+    }
+
+    // 以.*开头的自动机中状态总包含起始集合, 个数相等即处于起始状态
+    bool initial(const run_t& r) const
+    {
+        return r.cur->size == nfirst;
+    }
+
+    template <class SET> static size_t __count(const SET& s, size_t n)
+    {
+        return __list(s, n, NULL);
+    }
+
+    template <class SET> static size_t __list(const SET& s, size_t n, position_t* out)
+    {
+        size_t k = 0;
+        for (size_t i = 0; i < s._cap; i++)
         {
-            _prefix = (unsigned char*)MEM::allocate(_prelen);
-            memcpy(_prefix, buf, _prelen);
-            switch (_prelen)
-            {
-                case 0: break;
-                case 1:  _search_prefix_fun = &re_t::__sp1;  break;
-                case 2:  _search_prefix_fun = &re_t::__sp2;  break;
-                case 3:  _search_prefix_fun = &re_t::__sp3;  break;
-                case 4:  _search_prefix_fun = &re_t::__sp4;  break;
-                case 5:  _search_prefix_fun = &re_t::__sp5;  break;
-                case 6:  _search_prefix_fun = &re_t::__sp6;  break;
-                case 7:  _search_prefix_fun = &re_t::__sp7;  break;
-                case 8:  _search_prefix_fun = &re_t::__sp8;  break;
-                case 9:  _search_prefix_fun = &re_t::__sp9;  break;
-                case 10: _search_prefix_fun = &re_t::__sp10; break;
-                case 11: _search_prefix_fun = &re_t::__sp11; break;
-                case 12: _search_prefix_fun = &re_t::__sp12; break;
-                case 13: _search_prefix_fun = &re_t::__sp13; break;
-                case 14: _search_prefix_fun = &re_t::__sp14; break;
-                case 15: _search_prefix_fun = &re_t::__sp15; break;
-                case 16: _search_prefix_fun = &re_t::__sp16; break;
-                default: _search_prefix_fun = &re_t::__spx;  break;
-            }
-            if (_prelen >= 4)
+            word_t w = s._dat[i];
+            for (size_t j = 0; w; j++, w <<= 1)
             {
-                unsigned char *p, *e;
-                _pretable = (unsigned char*)MEM::allocate(256);
-                memset(_pretable, _prelen + 1, 256);
-                for (p = _prefix, e = _prefix + _prelen; p != e; p++)
+                size_t x = (i << X) + j;
+                if ((w & A) && x < n)
                 {
-                    _pretable[*p] = _prelen - (p - _prefix); 
-                } 
+                    if (out)
+                    {
+                        out[k] = (position_t)x;
+                    }
+                    k++;
+                }
             }
         }
-        return sample;
+        return k;
     }
+};
 
-    void __debug_state(state_iterator_t i) const
+/*
+ * 在输入中查找第一个属于起始字节集合的字节.
+ * 按集合大小和CPU支持选择: 1个字节用memchr, 2~3个字节用SSE2/AVX2逐字节比较,
+ * 更多字节用SSSE3/AVX2的半字节查表(Teddy), 其余情况逐字节查表
+ */
+struct _start_scanner_t
+{
+    typedef const unsigned char* (*scan_fun_ptr)(const _start_scanner_t*, const unsigned char*, const unsigned char*);
+
+    unsigned char table[256];
+    unsigned char bytes[4];
+    unsigned char lo[16];  // 低半字节所在的桶
+    unsigned char hi[16];  // 高半字节对应的桶, 高半字节超过8种时合并, 命中后需查table确认
+    size_t nbytes;
+    scan_fun_ptr fun;
+
+    void build(const bool* set)
     {
-        printf("%u\t", (*i)->id);
-        for (int j = 0; j <= (*i)->last(); j++)
+        unsigned char bucket[16];
+        size_t nhi = 0;
+        memset(this, 0, sizeof(_start_scanner_t));
+        for (int c = 0; c < 256; c++)
         {
-            if ((*i)->has(j))
+            if (set[c])
             {
-                printf("%d ", j);
+                table[c] = 1;
+                if (nbytes < sizeof(bytes))
+                {
+                    bytes[nbytes] = (unsigned char)c;
+                }
+                nbytes++;
             }
         }
-        printf("\t\t");
-        for (_delta_t* j = (*i)->deltas.begin(); j != (*i)->deltas.end(); j++)
+        for (int h = 0; h < 16; h++)
         {
-            if (j->input >= 33 && j->input <= 126)
-            {
-                printf("(%c, %d) ", j->input, j->id);
-            }
-            else
+            for (int l = 0; l < 16; l++)
             {
-                printf("(\\x%x, %d) ", j->input, j->id);
+                if (table[(h << 4) | l])
+                {
+                    bucket[h] = (unsigned char)(nhi++ & 7);
+                    break;
+                }
             }
         }
-        if ((*i)->ok)
+        for (int c = 0; c < 256; c++)
         {
-            printf("OK");
+            if (table[c])
+            {
+                hi[c >> 4] |= 1 << bucket[c >> 4];
+                lo[c & 15] |= 1 << bucket[c >> 4];
+            }
         }
-        printf("\n");
+        fun = __select();
     }
 
-    const unsigned char* __match_bthr(const unsigned char* p, const unsigned char* e)
+    __must_inline(const unsigned char*) scan(const unsigned char* p, const unsigned char* e) const
     {
-        size_t s = 0, a = 0;
-        const unsigned char* r = NULL;
-        while (p < e && !(a && matchmin))
+        return fun(this, p, e);
+    }
+
+    scan_fun_ptr __select() const
+    {
+        if (nbytes == 256)
+        {
+            return &__scan_all;
+        }
+        if (nbytes == 1)
         {
-            if ((s = _trans[(s << 8) + *p++]) >= 0xfe)
+            return &__scan_memchr;
+        }
+    #ifdef _RE_X86_SIMD
+        __builtin_cpu_init();
+        if (nbytes <= 3)
+        {
+            if (__builtin_cpu_supports("avx2"))
             {
-                break;
+                return &__scan_bytes_avx2;
             }
-            if ((a = _accept[s] && (!matchend || (matchend && p == e))))
+            if (__builtin_cpu_supports("sse2"))
             {
-                r = p;
+                return &__scan_bytes_sse2;
             }
         }
-        return r;
-    }
-
-    const unsigned char* __match_word_bthr(const unsigned char* p, const unsigned char* e)
-    {
-        size_t s = 0, a = 0;
-        const unsigned char* r = NULL;
-        while (p < e && !(a && matchmin) && (s = _trans[(s << 8) + *p++]) < 0xfe)
+        else if (nbytes <= 192)
         {
-            if (__exp1(!matchend))
-            {
-                a = _accept[s] && (p == e || _pretable[*p]);
-            }
-            else
+            if (__builtin_cpu_supports("avx2"))
             {
-                a = _accept[s] && p == e;
+                return &__scan_nibble_avx2;
             }
-            if (__exp1(a))
+            if (__builtin_cpu_supports("ssse3"))
             {
-                r = p;
+                return &__scan_nibble_ssse3;
             }
         }
-        return r;
+    #endif
+        return &__scan_table;
     }
 
-    const unsigned char* __match_athr(const unsigned char* p, const unsigned char* e)
+    static const unsigned char* __scan_all(const _start_scanner_t*, const unsigned char* p, const unsigned char*)
     {
-        return NULL;
+        return p;
     }
 
-    const unsigned char* __match_word_athr(const unsigned char* p, const unsigned char* e)
+    static const unsigned char* __scan_table(const _start_scanner_t* s, const unsigned char* p, const unsigned char* e)
     {
-        return NULL;
+        while (p != e && !s->table[*p])
+        {
+            p++;
+        }
+        return p;
     }
 
-    const unsigned char* __match_sample(const unsigned char* P, const unsigned char* E)
+    static const unsigned char* __scan_memchr(const _start_scanner_t* s, const unsigned char* p, const unsigned char* e)
     {
-        if (ptrdiff_t(E - P) >= ptrdiff_t(_prelen))
-        {
-            const unsigned short* p = (const unsigned short*)(P);
-            const unsigned short* q = (const unsigned short*)(_prefix);
-            const unsigned short* r = (const unsigned short*)(_prefix + _prelen - (_prelen & 1));
-            while (q != r && *p == *q)
-            {
-                p++;
-                q++;
-            }
-            if (q != r || (_prelen & 1 && *(const unsigned char*)r != *(const unsigned char*)p))
-            {
-                return NULL;
-            }
-            return (const unsigned char*)p;
-        }
-        return NULL;
+        const unsigned char* q = (const unsigned char*)memchr(p, s->bytes[0], e - p);
+        return q? q: e;
     }
 
-    int __search(const unsigned char* p, const unsigned char* e, results_t& results, long n)
+#ifdef _RE_X86_SIMD
+    __target("sse2") static const unsigned char* __scan_bytes_sse2(const _start_scanner_t* s, const unsigned char* p, const unsigned char* e)
     {
-        if (__exp1(p < e))
+        __m128i b0 = _mm_set1_epi8((char)s->bytes[0]);
+        __m128i b1 = _mm_set1_epi8((char)s->bytes[1]);
+        __m128i b2 = _mm_set1_epi8((char)s->bytes[s->nbytes - 1]);
+        while (e - p >= 16)
         {
-            if (__exp1(!matchbegin))
-            {
-                return (this->*_search_fun)(p, e, results, n);
-            }
-            else
+            __m128i v = _mm_loadu_si128((const __m128i*)p);
+            __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, b0), _mm_cmpeq_epi8(v, b1)), _mm_cmpeq_epi8(v, b2));
+            unsigned int mask = (unsigned int)_mm_movemask_epi8(m);
+            if (mask)
             {
-                const unsigned char* r = (this->*_match_fun)(p, e);
-                if (r)
-                {
-                    results.append(_result_t(p, r));
-                    if (!--n)
-                    {
-                        return RESULTS_ENOUGH;
-                    }
-                }
+                return p + __builtin_ctz(mask);
             }
+            p += 16;
         }
-        return RESULTS_NOT_ENOUGH;
+        return __scan_table(s, p, e);
     }
 
-    int __search_with_prefix_bthr(const unsigned char* p, const unsigned char* e, results_t& results, long n)
+    __target("avx2") static const unsigned char* __scan_bytes_avx2(const _start_scanner_t* s, const unsigned char* p, const unsigned char* e)
     {
-        size_t s, a;
-        const unsigned char *x, *y;
-        while ((p = (this->*_search_prefix_fun)(p, e)))
+        __m256i b0 = _mm256_set1_epi8((char)s->bytes[0]);
+        __m256i b1 = _mm256_set1_epi8((char)s->bytes[1]);
+        __m256i b2 = _mm256_set1_epi8((char)s->bytes[s->nbytes - 1]);
+        while (e - p >= 32)
         {
-            s = _prelen;
-            a = _accept[s];
-            x = p + _prelen;
-            y = cond_ptr(x, a);
-            while (x != e && !(a && matchmin))
-            {
-                if ((s = _trans[(s << 8) + *x++]) >= 0xfe)
-                {
-                    break;
-                }
-                if ((a = _accept[s] && (!matchend || (matchend && x == e))))
-                {
-                    y = x;
-                }
-            }
-            if (y)
-            {
-                results.append(_result_t(p, y));
-                if (!--n)
-                {
-                    return RESULTS_ENOUGH;
-                }
-                p = y;
-            }
-            else
+            __m256i v = _mm256_loadu_si256((const __m256i*)p);
+            __m256i m = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, b0), _mm256_cmpeq_epi8(v, b1)), _mm256_cmpeq_epi8(v, b2));
+            unsigned int mask = (unsigned int)_mm256_movemask_epi8(m);
+            if (mask)
             {
-                p++; 
-            }
-            if (s == 0xfe)
-            {
-                p = x;
+                return p + __builtin_ctz(mask);
             }
+            p += 32;
         }
-        return RESULTS_NOT_ENOUGH;
+        return __scan_table(s, p, e);
     }
 
-    int __search_without_prefix_bthr(const unsigned char* p, const unsigned char* e, results_t& results, long n)
+    __target("ssse3") static const unsigned char* __scan_nibble_ssse3(const _start_scanner_t* s, const unsigned char* p, const unsigned char* e)
     {
-        size_t s, a;
-        const unsigned char *x, *y;
-        while (p != e)
+        __m128i lo = _mm_loadu_si128((const __m128i*)s->lo);
+        __m128i hi = _mm_loadu_si128((const __m128i*)s->hi);
+        __m128i low4 = _mm_set1_epi8(0x0f);
+        __m128i zero = _mm_setzero_si128();
+        while (e - p >= 16)
         {
-            while (p != e && _trans[*p] == 0xff)  // 0xfe 不必出现在0状态中
-            {
-                p++;
-            }
-            if (p != e)
+            __m128i v = _mm_loadu_si128((const __m128i*)p);
+            __m128i l = _mm_shuffle_epi8(lo, _mm_and_si128(v, low4));
+            __m128i h = _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi16(v, 4), low4));
+            unsigned int mask = ~(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(l, h), zero)) & 0xffff;
+            while (mask)
             {
-                s = _trans[*p];
-                a = _accept[s];
-                x = p + 1;
-                y = cond_ptr(x, a);
-                while (x != e && !(a && matchmin))
-                {
-                    if ((s = _trans[(s << 8) + *x++]) >= 0xfe)  // 将此逻辑分析放到while的逻辑表达式中
-                    {
-                        break;
-                    }
-                    if ((a = _accept[s] && (!matchend || (matchend && x == e))))
-                    {
-                        y = x;
-                    }
-                }
-                if (y)
-                {
-                    results.append(_result_t(p, y));
-                    if (!--n)
-                    {
-                        return RESULTS_ENOUGH;
-                    }
-                    p = y;
-                }
-                else
+                const unsigned char* q = p + __builtin_ctz(mask);
+                if (s->table[*q])
                 {
-                    p++;
-                }
-                if (s == 0xfe)
-                {
-                    p = x;
+                    return q;
                 }
+                mask &= mask - 1;
             }
+            p += 16;
         }
-        return RESULTS_NOT_ENOUGH;
+        return __scan_table(s, p, e);
     }
 
-    int __search_word_bthr(const unsigned char* p, const unsigned char* e, results_t& results, long n)
+    __target("avx2") static const unsigned char* __scan_nibble_avx2(const _start_scanner_t* s, const unsigned char* p, const unsigned char* e)
     {
-        const unsigned char *q;
-        while (p != e)
+        __m256i lo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)s->lo));
+        __m256i hi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)s->hi));
+        __m256i low4 = _mm256_set1_epi8(0x0f);
+        __m256i zero = _mm256_setzero_si256();
+        while (e - p >= 32)
         {
-            while (p != e && _pretable[*p])
-            {
-                p++;
-            }
-            if ((q = __match_word_bthr(p, e)))
+            __m256i v = _mm256_loadu_si256((const __m256i*)p);
+            __m256i l = _mm256_shuffle_epi8(lo, _mm256_and_si256(v, low4));
+            __m256i h = _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi16(v, 4), low4));
+            unsigned int mask = ~(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(l, h), zero));
+            while (mask)
             {
-                results.append(_result_t(p, q));
-                if (!--n)
+                const unsigned char* q = p + __builtin_ctz(mask);
+                if (s->table[*q])
                 {
-                    return RESULTS_ENOUGH;
+                    return q;
                 }
-                p = q;   // +1 ??
-            }
-            else while (p != e && !_pretable[*p])
-            {
-                p++;
+                mask &= mask - 1;
             }
+            p += 32;
         }
-        return RESULTS_NOT_ENOUGH;
+        return __scan_table(s, p, e);
     }
+#endif
+};
 
-    int __search_with_prefix_athr(const unsigned char* p, const unsigned char* e, results_t& results, long n)
-    {
-        return RESULTS_NOT_ENOUGH;
-    }
+/*
+ * 查找任意长度的行分隔符, 找不到时返回NULL. 1个字节用memchr;
+ * 更长时在x86上一次比较16/32个位置的首尾两个字节, 候选位置再比较中间部分;
+ * 其余情况和向量化后剩下的尾部用与__sp*相同的Sunday算法
+ */
+struct _sep_finder_t
+{
+    typedef const unsigned char* (*find_fun_ptr)(const _sep_finder_t*, const unsigned char*, const unsigned char*);
 
-    int __search_without_prefix_athr(const unsigned char* p, const unsigned char* e, results_t& results, long n)
+    const unsigned char* sep;
+    size_t len;
+    bool overlap;  // 见overlapping
+    size_t shift[256];
+    find_fun_ptr fun;
+
+    _sep_finder_t(const char* s): sep((const unsigned char*)s), len(s? strlen(s): 0), overlap(s && overlapping(s))
     {
-        return RESULTS_NOT_ENOUGH;
+        for (int c = 0; c < 256; c++)
+        {
+            shift[c] = len + 1;
+        }
+        for (size_t i = 0; i < len; i++)
+        {
+            shift[sep[i]] = len - i;
+        }
+        fun = __select();
     }
 
-    int __search_word_athr(const unsigned char* p, const unsigned char* e, results_t& results, long n)
+    __must_inline(const unsigned char*) find(const unsigned char* p, const unsigned char* e) const
     {
-        return RESULTS_NOT_ENOUGH;
+        return fun(this, p, e);
     }
 
-    int __search_sample(const unsigned char* p, const unsigned char* e, results_t& results, long n)
+    // 分隔符的真后缀与前缀相同, 例如"aa", 这时切分结果与从哪里开始查找有关
+    static bool overlapping(const char* s)
     {
-        const unsigned char* q;
-        while ((p = (this->*_search_prefix_fun)(p, e)) && --n)
+        size_t n = strlen(s);
+        for (size_t k = 1; k < n; k++)
         {
-            q = p + _prelen;
-            results.append(_result_t(p, q));
-            p = q;
+            if (!memcmp(s, s + k, n - k))
+            {
+                return true;
+            }
         }
-        return !n;
+        return false;
     }
 
-    const unsigned char* __sp1(const unsigned char* P, const unsigned char* E)
+    find_fun_ptr __select() const
+    {
+        if (len == 0)
+        {
+            return &__find_none;
+        }
+        if (len == 1)
+        {
+            return &__find_memchr;
+        }
+    #ifdef _RE_X86_SIMD
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+        {
+            return &__find_avx2;
+        }
+        if (__builtin_cpu_supports("sse2"))
+        {
+            return &__find_sse2;
+        }
+    #endif
+        return &__find_sunday;
+    }
+
+    static const unsigned char* __find_none(const _sep_finder_t*, const unsigned char*, const unsigned char*)
+    {
+        return NULL;
+    }
+
+    static const unsigned char* __find_memchr(const _sep_finder_t* f, const unsigned char* p, const unsigned char* e)
+    {
+        return p < e? (const unsigned char*)memchr(p, *f->sep, e - p): NULL;
+    }
+
+    static const unsigned char* __find_sunday(const _sep_finder_t* f, const unsigned char* p, const unsigned char* e)
+    {
+        while (size_t(e - p) >= f->len)
+        {
+            if (*p == *f->sep && !memcmp(p + 1, f->sep + 1, f->len - 1))
+            {
+                return p;
+            }
+            if (size_t(e - p) == f->len)
+            {
+                break;
+            }
+            p += f->shift[p[f->len]];
+        }
+        return NULL;
+    }
+
+#ifdef _RE_X86_SIMD
+    __target("sse2") static const unsigned char* __find_sse2(const _sep_finder_t* f, const unsigned char* p, const unsigned char* e)
+    {
+        __m128i c0 = _mm_set1_epi8((char)f->sep[0]);
+        __m128i c1 = _mm_set1_epi8((char)f->sep[f->len - 1]);
+        while (e - p >= ptrdiff_t(f->len + 15))
+        {
+            __m128i v0 = _mm_loadu_si128((const __m128i*)p);
+            __m128i v1 = _mm_loadu_si128((const __m128i*)(p + f->len - 1));
+            unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(v0, c0), _mm_cmpeq_epi8(v1, c1)));
+            while (mask)
+            {
+                const unsigned char* q = p + __builtin_ctz(mask);
+                if (!memcmp(q + 1, f->sep + 1, f->len - 2))
+                {
+                    return q;
+                }
+                mask &= mask - 1;
+            }
+            p += 16;
+        }
+        return __find_sunday(f, p, e);
+    }
+
+    __target("avx2") static const unsigned char* __find_avx2(const _sep_finder_t* f, const unsigned char* p, const unsigned char* e)
+    {
+        __m256i c0 = _mm256_set1_epi8((char)f->sep[0]);
+        __m256i c1 = _mm256_set1_epi8((char)f->sep[f->len - 1]);
+        while (e - p >= ptrdiff_t(f->len + 31))
+        {
+            __m256i v0 = _mm256_loadu_si256((const __m256i*)p);
+            __m256i v1 = _mm256_loadu_si256((const __m256i*)(p + f->len - 1));
+            unsigned int mask = (unsigned int)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(v0, c0), _mm256_cmpeq_epi8(v1, c1)));
+            while (mask)
+            {
+                const unsigned char* q = p + __builtin_ctz(mask);
+                if (!memcmp(q + 1, f->sep + 1, f->len - 2))
+                {
+                    return q;
+                }
+                mask &= mask - 1;
+            }
+            p += 32;
+        }
+        return __find_sunday(f, p, e);
+    }
+#endif
+};
+
+struct _result_t
+{
+    const unsigned char* p;
+    const unsigned char* e;
+
+    _result_t(): p(NULL), e(NULL)
+    {}
+
+    _result_t(const unsigned char* x, const unsigned char* y): p(x), e(y)
+    {}
+
+    std::string to_string()
+    {
+        return std::string((const char*)p, (const char*)e);
+    }
+
+    std::string& to_string(std::string& str)
+    {
+        str.assign((const char*)p, (const char*)e);
+        return str;
+    }
+};
+
+/*
+ * 捕获分组: 在已经找到的匹配[p, e)上运行带标记的位置自动机.
+ * 第g个分组(从1起)的起止是标记2g-2和2g-1, 记在位置之间的边上: 离开分组时记终点, 进入时记起点.
+ * 边按回溯时的尝试顺序排列(分支先左后右, 重复先继续后离开), 同一步中先到达某位置的线程优先,
+ * 所以得到的是回溯引擎在这一范围上的第一个解, 但不回溯.
+ * 某次重复中没有参与的分组保留上一次的值, 从未参与的为[NULL, NULL).
+ *
+ * 线程的先后只取决于读入的字节, 与标记的值无关, 所以按需做子集构造: 状态是按优先顺序排列的位置列表,
+ * 转移上记着新的第k个线程由原来的哪个线程经哪条边得到. 扫描时每个字节查一次表,
+ * 线程和标记都不变的转移(如在\d+中)不做任何事, 否则按转移复制标记
+ */
+template <class MEM> struct _submatch_t
+{
+    struct _edge_t
+    {
+        position_t to;
+        U32 off;  // 标记在_ops[off, off + len)
+        U32 len;
+
+        _edge_t(position_t x, U32 y, U32 z): to(x), off(y), len(z)
+        {}
+    };
+
+    // 转移后的一个线程: 来自原来的第from个线程, 再写_ops[off, off + len)中的标记
+    struct _move_t
+    {
+        position_t from;
+        U32 off;
+        U32 len;
+
+        _move_t(position_t x, U32 y, U32 z): from(x), off(y), len(z)
+        {}
+    };
+
+    struct _step_t
+    {
+        U32 to;     // 目标状态, DEAD时不再有匹配
+        U32 moves;  // 目标状态的第k个线程由_moves[moves + k]得到
+        bool same;  // 线程和标记都不变
+
+        _step_t(U32 x, U32 y, bool z): to(x), moves(y), same(z)
+        {}
+    };
+
+    static const U32 DEAD = 0xffffffff;
+    static const U32 NONE = 0xffffffff;
+
+    array_t<_edge_t, MEM> _edges;
+    array_t<U16, MEM> _ops;
+    array_t<U32, MEM> _offs;  // 位置i的边为_edges[_offs[i], _offs[i + 1]), 第_num组是起始的边
+    array_t<U32, MEM> _chars; // 各位置的字符集, 每个位置8个U32
+    size_t _num;
+    size_t _tags;
+    position_t _reception;
+    unsigned char _classes[256];  // 所有位置都不加区分的字节为一类
+    size_t _nclasses;
+
+    array_t<position_t, MEM> _lists;  // 状态i的位置列表为_lists[_heads[i], _heads[i + 1])
+    array_t<U32, MEM> _heads;
+    array_t<U32, MEM> _hashes;
+    array_t<U32, MEM> _accepts;       // reception在状态中的序号, 没有时为NONE
+    array_t<U32, MEM> _rows;          // 状态 * _nclasses + 字节类 -> _steps中的序号 + 1, 0为未求出
+    array_t<_step_t, MEM> _steps;
+    array_t<_move_t, MEM> _moves;
+    array_t<position_t, MEM> _tmp;
+    U32* _slots;                      // 由位置列表找状态, 存状态 + 1
+    size_t _mask;
+    U32 _init;                        // 起始的转移 + 1
+    size_t _flushes;
+    const unsigned char** _vals[2];   // 当前和下一步各线程的标记, 每个线程_tags个
+    size_t* _stamp;                   // 求转移时目标位置是否已经出现
+    size_t _gen;
+    void* _work;
+
+    _submatch_t(): _num(0), _tags(0), _reception(0), _nclasses(0), _slots(NULL), _mask(0),
+        _init(0), _flushes(0), _stamp(NULL), _gen(0), _work(NULL)
+    {}
+
+    ~_submatch_t()
+    {
+        MEM::deallocate(_slots);
+        MEM::deallocate(_work);
+    }
+
+    static _submatch_t* create()
+    {
+        _submatch_t* p = (_submatch_t*)MEM::allocate(sizeof(_submatch_t));
+        ::new (p) _submatch_t();
+        return p;
+    }
+
+    static void release(_submatch_t* p)
+    {
+        if (p)
+        {
+            p->~_submatch_t();
+            MEM::deallocate(p);
+        }
+    }
+
+    template <class M> void build(_tree_t<M>& tree)
+    {
+        _builder_t<M> b(tree, *this);
+        _num = tree.reception_pos() + 1;
+        _tags = tree.ngroups * 2;
+        _reception = tree.reception_pos();
+        for (size_t i = 0; i < _num; i++)
+        {
+            _offs.append((U32)_edges.size());
+            b.edges_from((position_t)i);
+            for (int k = 0; k < 8; k++)
+            {
+                U32 w = 0;
+                for (int c = 0; c < 32; c++)
+                {
+                    if (tree.node_at_pos((position_t)i)->has((k << 5) + c))
+                    {
+                        w |= (U32)1 << c;
+                    }
+                }
+                _chars.append(w);
+            }
+        }
+        _offs.append((U32)_edges.size());
+        b.start_edges();
+        _offs.append((U32)_edges.size());
+        __build_classes();
+
+        size_t n = 2 * _num * _tags * sizeof(const unsigned char*) + (_num + 1) * sizeof(size_t);
+        const unsigned char** p = (const unsigned char**)MEM::allocate(n);
+        memset(p, 0, n);
+        _work = p;
+        _vals[0] = p;
+        _vals[1] = p + _num * _tags;
+        _stamp = (size_t*)(p + 2 * _num * _tags);
+        _heads.append((U32)0);
+        __rehash(64);
+    }
+
+    // 逐个位置细分: 已在同一类中的字节, 按能否被这个位置读入再分开
+    void __build_classes()
+    {
+        memset(_classes, 0, sizeof(_classes));
+        _nclasses = 1;
+        for (size_t i = 0; i < _num; i++)
+        {
+            int map[512];
+            size_t n = 0;
+            for (size_t k = 0; k < 2 * _nclasses; k++)
+            {
+                map[k] = -1;
+            }
+            for (int c = 0; c < 256; c++)
+            {
+                int key = _classes[c] * 2 + __has(i, c);
+                if (map[key] < 0)
+                {
+                    map[key] = (int)n++;
+                }
+                _classes[c] = (unsigned char)map[key];
+            }
+            _nclasses = n;
+        }
+    }
+
+    bool __has(size_t pos, int c) const
+    {
+        return (_chars[(pos << 3) + (c >> 5)] & ((U32)1 << (c & 31))) != 0;
+    }
+
+    // [p, e)须是一个完整的匹配, spans[0]为整个匹配, spans[g]为第g个分组
+    bool run(const unsigned char* p, const unsigned char* e, _result_t* spans)
+    {
+        return __scan(p, e, true, spans) != NULL;
+    }
+
+    // 从p起最长的匹配, 同时求出各分组, 返回匹配的结尾, 没有匹配时返回NULL
+    const unsigned char* longest(const unsigned char* p, const unsigned char* e, _result_t* spans)
+    {
+        return __scan(p, e, false, spans);
+    }
+
+    const unsigned char* __scan(const unsigned char* p, const unsigned char* e, bool whole, _result_t* spans)
+    {
+        const unsigned char** cur = _vals[0];
+        const unsigned char** nxt = _vals[1];
+        const unsigned char* end = NULL;
+        size_t s = NONE;
+        size_t k = _init? _init - 1: __next(s, -1);
+        if (_steps[k].to == DEAD)
+        {
+            return NULL;
+        }
+        for (size_t i = 0; i < _tags; i++)
+        {
+            cur[i] = NULL;
+        }
+        __apply(_steps[k], cur, nxt, p);
+        __swap(cur, nxt);
+        s = _steps[k].to;
+        const unsigned char* x = p;
+        for (; ; x++)
+        {
+            if (!whole && _accepts[s] != NONE)
+            {
+                end = x;
+                __save(cur + _accepts[s] * _tags, p, x, spans);
+            }
+            if (x == e)
+            {
+                break;
+            }
+            U32 r = _rows[s * _nclasses + _classes[*x]];
+            k = r? r - 1: __next(s, *x);
+            const _step_t& step = _steps[k];
+            if (step.to == DEAD)
+            {
+                break;
+            }
+            if (!step.same)
+            {
+                __apply(step, cur, nxt, x + 1);
+                __swap(cur, nxt);
+            }
+            s = step.to;
+        }
+        if (whole)
+        {
+            if (x != e || _accepts[s] == NONE)
+            {
+                return NULL;
+            }
+            end = e;
+            __save(cur + _accepts[s] * _tags, p, e, spans);
+        }
+        return end;
+    }
+
+    static void __swap(const unsigned char**& a, const unsigned char**& b)
+    {
+        const unsigned char** t = a;
+        a = b;
+        b = t;
+    }
+
+    void __apply(const _step_t& step, const unsigned char** cur, const unsigned char** nxt, const unsigned char* here)
+    {
+        size_t n = _heads[step.to + 1] - _heads[step.to];
+        size_t tags = _tags;
+        const U16* ops = _ops.begin();
+        const _move_t* m = _moves.begin() + step.moves;
+        for (size_t k = 0; k < n; k++, m++, nxt += tags)
+        {
+            memcpy(nxt, cur + m->from * tags, tags * sizeof(const unsigned char*));
+            for (U32 i = m->off; i < m->off + m->len; i++)
+            {
+                nxt[ops[i]] = here;
+            }
+        }
+    }
+
+    void __save(const unsigned char* const* t, const unsigned char* p, const unsigned char* e, _result_t* spans)
+    {
+        spans[0] = _result_t(p, e);
+        for (size_t g = 0; g < _tags; g += 2)
+        {
+            spans[g / 2 + 1] = t[g] && t[g + 1]? _result_t(t[g], t[g + 1]): _result_t();
+        }
+    }
+
+    /*
+     * 求状态s读入c的转移, s为NONE时是起始的转移(c为-1). 缓存超过LAZY_CACHE_SIZE时清空,
+     * 只保留s, s随之改变
+     */
+    size_t __next(size_t& s, int c)
+    {
+        if (__exp0(__used() > LAZY_CACHE_SIZE))
+        {
+            __flush(s);
+        }
+        const position_t start = (position_t)_num;
+        const position_t* list = s == NONE? &start: _lists.begin() + _heads[s];
+        size_t n = s == NONE? 1: _heads[s + 1] - _heads[s];
+        size_t moves = _moves.size();
+        bool same = true;
+        _tmp.clear();
+        _gen++;
+        for (size_t k = 0; k < n; k++)
+        {
+            if (c >= 0 && !__has(list[k], c))
+            {
+                continue;
+            }
+            for (U32 i = _offs[list[k]]; i < _offs[list[k] + 1]; i++)
+            {
+                const _edge_t& edge = _edges[i];
+                if (_stamp[edge.to] == _gen)
+                {
+                    continue;
+                }
+                _stamp[edge.to] = _gen;
+                same = same && k == _tmp.size() && !edge.len;
+                _tmp.append(edge.to);
+                _moves.append(_move_t((position_t)k, edge.off, edge.len));
+            }
+        }
+        U32 to = DEAD;
+        if (_tmp.size())
+        {
+            U32 h = __hash(_tmp.begin(), _tmp.size());
+            to = __find(_tmp.begin(), _tmp.size(), h);
+            if (to == NONE)
+            {
+                to = __add(_tmp.begin(), _tmp.size(), h);
+            }
+        }
+        else
+        {
+            while (_moves.size() > moves)
+            {
+                _moves.pop_back();
+            }
+        }
+        same = c >= 0 && (!_tags || (same && to == s));
+        _steps.append(_step_t(to, (U32)moves, same));
+        size_t k = _steps.size() - 1;
+        if (c < 0)
+        {
+            _init = (U32)k + 1;
+        }
+        else
+        {
+            _rows[s * _nclasses + _classes[c]] = (U32)k + 1;
+        }
+        return k;
+    }
+
+    size_t __used() const
+    {
+        return _lists.size() * sizeof(position_t) + _rows.size() * sizeof(U32) +
+            _moves.size() * sizeof(_move_t) + _steps.size() * sizeof(_step_t) + (_mask + 1) * sizeof(U32);
+    }
+
+    void __flush(size_t& s)
+    {
+        _tmp.clear();
+        if (s != NONE)
+        {
+            _tmp.append(_lists.begin() + _heads[s], _lists.begin() + _heads[s + 1]);
+        }
+        _lists.clear();
+        _heads.clear();
+        _heads.append((U32)0);
+        _hashes.clear();
+        _accepts.clear();
+        _rows.clear();
+        _steps.clear();
+        _moves.clear();
+        memset(_slots, 0, (_mask + 1) * sizeof(U32));
+        _init = 0;
+        _flushes++;
+        if (s != NONE)
+        {
+            s = __add(_tmp.begin(), _tmp.size(), __hash(_tmp.begin(), _tmp.size()));
+        }
+    }
+
+    static U32 __hash(const position_t* list, size_t n)
+    {
+        U32 h = 2166136261u;
+        for (size_t i = 0; i < n; i++)
+        {
+            h = (h ^ list[i]) * 16777619u;
+        }
+        return h;
+    }
+
+    U32 __find(const position_t* list, size_t n, U32 h) const
+    {
+        for (size_t i = h & _mask; _slots[i]; i = (i + 1) & _mask)
+        {
+            U32 id = _slots[i] - 1;
+            if (_hashes[id] == h && _heads[id + 1] - _heads[id] == n &&
+                !memcmp(_lists.begin() + _heads[id], list, n * sizeof(position_t)))
+            {
+                return id;
+            }
+        }
+        return NONE;
+    }
+
+    U32 __add(const position_t* list, size_t n, U32 h)
+    {
+        U32 id = (U32)_hashes.size();
+        U32 accept = NONE;
+        if ((id + 1) << 1 > _mask + 1)
+        {
+            __rehash((_mask + 1) << 1);
+        }
+        for (size_t i = 0; i < n; i++)
+        {
+            _lists.append(list[i]);
+            if (list[i] == _reception)
+            {
+                accept = (U32)i;
+            }
+        }
+        _heads.append((U32)_lists.size());
+        _hashes.append(h);
+        _accepts.append(accept);
+        for (size_t i = 0; i < _nclasses; i++)
+        {
+            _rows.append((U32)0);
+        }
+        size_t i = h & _mask;
+        while (_slots[i])
+        {
+            i = (i + 1) & _mask;
+        }
+        _slots[i] = id + 1;
+        return id;
+    }
+
+    void __rehash(size_t cap)
+    {
+        MEM::deallocate(_slots);
+        _slots = (U32*)MEM::allocate(cap * sizeof(U32));
+        memset(_slots, 0, cap * sizeof(U32));
+        _mask = cap - 1;
+        for (U32 id = 0; id < _hashes.size(); id++)
+        {
+            size_t i = _hashes[id] & _mask;
+            while (_slots[i])
+            {
+                i = (i + 1) & _mask;
+            }
+            _slots[i] = id + 1;
+        }
+    }
+
+    /*
+     * 从语法树求出各位置的边. first(x)是进入x后按优先顺序可以读入的位置,
+     * 其中to为EXIT的一项表示x匹配空串后离开, 各结点的first按需求出后保留.
+     * 与ECMAScript相同, 重复的可选部分不做空的一次, 如(a?)*中a?匹配空串时不算作一次
+     */
+    template <class M> struct _builder_t
+    {
+        typedef _node_t<M> node_t;
+        typedef array_t<_edge_t, M> edges_t;
+
+        static const position_t EXIT = NOPOS;
+
+        _tree_t<M>& tree;
+        _submatch_t& sub;
+        node_t* base;
+        node_t** parent;
+        edges_t** memo;
+        array_t<U16, M> pool;    // memo中的边的标记
+        array_t<U16, M> ops;
+        size_t* stamp;           // first()的一组边中目标位置是否已经出现, 最后一项是EXIT
+        size_t* seen;            // 同上, 用于写入sub的一组边
+        size_t gen;
+        size_t mark;
+        size_t num;
+
+        _builder_t(_tree_t<M>& t, _submatch_t& s): tree(t), sub(s), base(t._nodes.begin()), gen(0), mark(0)
+        {
+            size_t n = t._nodes.size();
+            num = t.reception_pos() + 1;
+            parent = (node_t**)M::allocate(n * sizeof(node_t*));
+            memo = (edges_t**)M::allocate(n * sizeof(edges_t*));
+            stamp = (size_t*)M::allocate((num + 1) * sizeof(size_t));
+            seen = (size_t*)M::allocate((num + 1) * sizeof(size_t));
+            memset(parent, 0, n * sizeof(node_t*));
+            memset(memo, 0, n * sizeof(edges_t*));
+            memset(stamp, 0, (num + 1) * sizeof(size_t));
+            memset(seen, 0, (num + 1) * sizeof(size_t));
+            for (node_t* p = base; p != t._nodes.end(); p++)
+            {
+                if (p->l)
+                {
+                    parent[p->l - base] = p;
+                }
+                if (p->r)
+                {
+                    parent[p->r - base] = p;
+                }
+            }
+        }
+
+        ~_builder_t()
+        {
+            for (size_t i = 0; i < tree._nodes.size(); i++)
+            {
+                edges_t::release(memo[i]);
+            }
+            M::deallocate(parent);
+            M::deallocate(memo);
+            M::deallocate(stamp);
+            M::deallocate(seen);
+        }
+
+        // 以x为根的分组的起点(end为false)或终点的标记追加到out
+        void group_tags(node_t* x, bool end, array_t<U16, M>& out)
+        {
+            for (size_t i = 0; i < tree.groups.size(); i++)
+            {
+                if (tree.groups[i].node == size_t(x - base))
+                {
+                    out.append((U16)(tree.groups[i].id * 2 - 2 + end));
+                }
+            }
+        }
+
+        edges_t* first(node_t* x)
+        {
+            edges_t*& res = memo[x - base];
+            if (res)
+            {
+                return res;
+            }
+            if (x->type > OK)
+            {
+                first(x->r);  // 先求出子结点的, 以免递归时改动stamp
+                if (x->l)
+                {
+                    first(x->l);
+                }
+            }
+            edges_t* list = edges_t::create();
+            array_t<U16, M> pre, post;
+            group_tags(x, false, pre);
+            group_tags(x, true, post);
+            gen++;
+            if (x->type <= OK)
+            {
+                __put(list, x->pos, pre, 0, 0, 0, 0, post);
+                if (x->nul)
+                {
+                    __put(list, EXIT, pre, 0, 0, 0, 0, post);  // 计数结点可以0次
+                }
+            }
+            else if (x->type == CAT)
+            {
+                const edges_t* l = memo[x->l - base];
+                const edges_t* r = memo[x->r - base];
+                for (const _edge_t* i = l->begin(); i != l->end(); i++)
+                {
+                    if (i->to != EXIT)
+                    {
+                        __put(list, i->to, pre, i->off, i->len, 0, 0, post);
+                        continue;
+                    }
+                    for (const _edge_t* j = r->begin(); j != r->end(); j++)
+                    {
+                        __put(list, j->to, pre, i->off, i->len, j->off, j->len, post);
+                    }
+                }
+            }
+            else
+            {
+                // OR依次是左右两边; 重复先进入一次, STAR和QUST再是跳过
+                bool empty = x->type == OR || x->type == PLUS;
+                if (x->l)
+                {
+                    __put_all(list, memo[x->l - base], pre, post, empty);
+                }
+                __put_all(list, memo[x->r - base], pre, post, empty);
+                if (!empty)
+                {
+                    __put(list, EXIT, pre, 0, 0, 0, 0, post);
+                }
+            }
+            return res = list;
+        }
+
+        /*
+         * 读入位置pos之后可以走到的位置: 计数结点先在内部继续, 然后从叶结点向上找
+         */
+        void edges_from(position_t pos)
+        {
+            node_t* node = tree.node_at_pos(pos);
+            mark = ++gen;
+            ops.clear();
+            if (node->type == OK)
+            {
+                return;
+            }
+            if (node->hi)
+            {
+                size_t k = pos - node->pos;
+                if (k + 1 < node->hi)
+                {
+                    __emit(pos + 1, NULL, 0);
+                }
+                if (k + 1 < node->lo)
+                {
+                    return;
+                }
+            }
+            group_tags(node, true, ops);
+            __leave(node);
+        }
+
+        void start_edges()
+        {
+            const edges_t* list = first(tree.root);
+            mark = ++gen;
+            ops.clear();
+            for (const _edge_t* i = list->begin(); i != list->end(); i++)
+            {
+                __emit(i->to, pool.begin() + i->off, i->len);
+            }
+        }
+
+        /*
+         * 离开child之后: 在CAT的左边时进入右边, 右边匹配空串时再向上;
+         * 在STAR/PLUS中时先重复一次, 再向上; 其他结点直接向上. ops为路上已有的标记
+         */
+        void __leave(node_t* child)
+        {
+            node_t* p = parent[child - base];
+            if (!p)
+            {
+                return;
+            }
+            size_t n = ops.size();
+            if ((p->type == CAT && child == p->l) || p->type == STAR || p->type == PLUS)
+            {
+                const edges_t* list = first(p->r);
+                for (const _edge_t* i = list->begin(); i != list->end(); i++)
+                {
+                    if (i->to != EXIT)
+                    {
+                        __emit(i->to, pool.begin() + i->off, i->len);
+                    }
+                    else if (p->type == CAT)
+                    {
+                        ops.append(pool.begin() + i->off, pool.begin() + i->off + i->len);
+                        group_tags(p, true, ops);
+                        __leave(p);
+                        __truncate(n);
+                    }
+                }
+                if (p->type == CAT)
+                {
+                    return;
+                }
+            }
+            group_tags(p, true, ops);
+            __leave(p);
+            __truncate(n);
+        }
+
+        void __truncate(size_t n)
+        {
+            while (ops.size() > n)
+            {
+                ops.pop_back();
+            }
+        }
+
+        // 写入sub的一条边, 标记为ops加上more; 已出现过的目标位置跳过
+        void __emit(position_t to, const U16* more, size_t m)
+        {
+            if (seen[to] == mark)
+            {
+                return;
+            }
+            seen[to] = mark;
+            sub._edges.append(_edge_t(to, (U32)sub._ops.size(), (U32)(ops.size() + m)));
+            sub._ops.append(ops.begin(), ops.end());
+            sub._ops.append(more, more + m);
+        }
+
+        // from中各项加上前缀pre放入list, empty为false时不要其中的EXIT
+        void __put_all(edges_t* list, const edges_t* from, const array_t<U16, M>& pre, const array_t<U16, M>& post, bool empty)
+        {
+            for (const _edge_t* i = from->begin(); i != from->end(); i++)
+            {
+                if (i->to != EXIT || empty)
+                {
+                    __put(list, i->to, pre, i->off, i->len, 0, 0, post);
+                }
+            }
+        }
+
+        // list中加入一项, 标记依次为pre, pool[a, a + n), pool[b, b + m), 离开x的还要加上post
+        void __put(edges_t* list, position_t to, const array_t<U16, M>& pre, U32 a, U32 n, U32 b, U32 m, const array_t<U16, M>& post)
+        {
+            size_t slot = to == EXIT? num: to;
+            if (stamp[slot] == gen)
+            {
+                return;
+            }
+            stamp[slot] = gen;
+            U32 off = (U32)pool.size();
+            pool.append(pre.begin(), pre.end());
+            for (U32 i = 0; i < n + m; i++)
+            {
+                U16 v = pool[i < n? a + i: b + i - n];  // append可能搬动pool, 不能传引用
+                pool.append(v);
+            }
+            if (to == EXIT)
+            {
+                pool.append(post.begin(), post.end());
+            }
+            list->append(_edge_t(to, off, (U32)(pool.size() - off)));
+        }
+    };
+};
+
+template <class MEM> struct _results_t: public array_t<_result_t, MEM>
+{
+    const unsigned char* next_begin() const
+    {
+        return this->last().e;
+    }
+
+    bool put(const unsigned char* p, const unsigned char* e)
+    {
+        this->append(_result_t(p, e));
+        return true;
+    }
+};
+
+/*
+ * search_into的结果接收者都提供 bool put(p, e), 返回false时停止搜索.
+ * 以下几种都不分配内存
+ */
+
+// 只计数
+struct _count_sink_t
+{
+    size_t count;
+
+    _count_sink_t(): count(0)
+    {}
+
+    bool put(const unsigned char*, const unsigned char*)
+    {
+        count++;
+        return true;
+    }
+};
+
+// 写入调用者提供的定长数组, 写满时停止
+struct _span_sink_t
+{
+    _result_t* _dat;
+    size_t _cap;
+    size_t _size;
+
+    _span_sink_t(_result_t* dat, size_t cap): _dat(dat), _cap(cap), _size(0)
+    {}
+
+    bool put(const unsigned char* p, const unsigned char* e)
+    {
+        if (_size == _cap)
+        {
+            return false;
+        }
+        _dat[_size++] = _result_t(p, e);
+        return _size < _cap;
+    }
+
+    size_t size() const
+    {
+        return _size;
+    }
+
+    bool full() const
+    {
+        return _size == _cap;
+    }
+};
+
+// 每个匹配调用一次 f(p, e), f返回false时停止
+template <class F> struct _callback_sink_t
+{
+    F& f;
+
+    _callback_sink_t(F& fun): f(fun)
+    {}
+
+    bool put(const unsigned char* p, const unsigned char* e)
+    {
+        return f(p, e);
+    }
+};
+
+// 记录经过的匹配个数, search_into的返回值和文字窗口中扣减n都用它
+template <class SINK> struct _counted_sink_t
+{
+    SINK& sink;
+    size_t count;
+
+    _counted_sink_t(SINK& s): sink(s), count(0)
+    {}
+
+    bool put(const unsigned char* p, const unsigned char* e)
+    {
+        count++;
+        return sink.put(p, e);
+    }
+};
+
+// 以绝对偏移表示的匹配结果, 用于流式输入等结果不能指向调用者内存的场合
+struct _offset_result_t
+{
+    size_t begin;
+    size_t end;
+
+    _offset_result_t(size_t x, size_t y): begin(x), end(y)
+    {}
+
+    size_t length() const
+    {
+        return end - begin;
+    }
+};
+
+template <class MEM> struct _offset_results_t: public array_t<_offset_result_t, MEM>
+{};
+
+template <class MEM> struct _stream_t;
+
+/*
+ * 编译映像的头部, 其后依次为表达式, 前缀, 等价类, 接受表, 转移表, 各段按8字节对齐.
+ * sample为1时只有前缀, 没有后面三段; LAZY_DFA模式只保存表达式, 载入时重新编译
+ */
+struct _image_header_t
+{
+    char magic[4];         // "MYRE"
+    U16 version;
+    U16 order;             // 0x0102, 用于检查字节序
+    U32 checksum;          // 头部之后全部内容的FNV-1a
+    U32 flag;
+    U32 num;
+    U32 explen;
+    U32 prelen;
+    unsigned char cshift;
+    unsigned char sample;
+    unsigned char pad[2];
+    U32 size;              // 映像总长度
+
+    static size_t align(size_t n)
+    {
+        return (n + 7) & ~(size_t)7;
+    }
+
+    static U32 fnv1a(const unsigned char* p, const unsigned char* e)
+    {
+        U32 h = 2166136261u;
+        while (p != e)
+        {
+            h = (h ^ *p++) * 16777619u;
+        }
+        return h;
+    }
+
+    // 按头部中的长度计算各段偏移, 返回映像总长度
+    size_t layout(size_t& preoff, size_t& clsoff, size_t& accoff, size_t& transoff) const
+    {
+        size_t off = align(sizeof(_image_header_t) + explen);
+        preoff = off;
+        off = clsoff = align(off + prelen);
+        if (sample || !num)
+        {
+            return accoff = transoff = off;
+        }
+        off = accoff = align(off + 256);
+        off = transoff = align(off + num);
+        return align(off + ((size_t)num << cshift) * (num <= THR? 1: sizeof(U16)));
+    }
+};
+
+/*
+ * 编译结果中只读的部分: 表达式, 转移表, 等价类, 前缀, 惰性DFA的位置自动机等, 由多个re_t按引用计数共享.
+ * re_t中同名的指针只是这里的视图, 惰性DFA的状态缓存在搜索时会被修改, 不在此列
+ */
+template <class MEM> struct _program_t
+{
+#ifdef _RE_THREADS
+    std::atomic<size_t> refs;
+#else
+    size_t refs;
+#endif
+    char* exp;
+    unsigned char* prefix;
+    unsigned char* pretable;
+    unsigned char* window;
+    bool* accept;
+    unsigned char* trans;
+    U16* wtrans;
+    unsigned char* classes;
+    _bit_nfa_t* bits;
+    _pike_vm_t<MEM>* vm;
+    array_t<_nfa_t<MEM>*, MEM> nfas;  // re_t的各个惰性DFA所用的位置自动机
+    void* image;      // 载入的映像, 表直接指向其中
+    size_t imagelen;
+    bool mapped;
+
+    _program_t(): refs(1), exp(NULL), prefix(NULL), pretable(NULL), window(NULL),
+        accept(NULL), trans(NULL), wtrans(NULL), classes(NULL), bits(NULL), vm(NULL), image(NULL), imagelen(0), mapped(false)
+    {}
+
+    ~_program_t()
+    {
+        if (mapped)
+        {
+        #ifdef _RE_POSIX_IO
+            munmap(image, imagelen);
+        #endif
+        }
+        else
+        {
+            MEM::deallocate(image);
+        }
+        MEM::deallocate(exp);
+        MEM::deallocate(prefix);
+        MEM::deallocate(pretable);
+        MEM::deallocate(window);
+        MEM::deallocate(accept);
+        MEM::deallocate(trans);
+        MEM::deallocate(wtrans);
+        MEM::deallocate(classes);
+        MEM::deallocate(bits);
+        if (vm)
+        {
+            for (int i = 0; i < 3; i++)
+            {
+                vm[i].clear();
+            }
+            MEM::deallocate(vm);
+        }
+        for (_nfa_t<MEM>** i = nfas.begin(); i != nfas.end(); i++)
+        {
+            _nfa_t<MEM>::release(*i);
+        }
+    }
+
+    static _program_t* create()
+    {
+        _program_t* p = (_program_t*)MEM::allocate(sizeof(_program_t));
+        ::new (p) _program_t();
+        return p;
+    }
+
+    static _program_t* retain(_program_t* p)
+    {
+        if (p)
+        {
+            p->refs++;
+        }
+        return p;
+    }
+
+    static void release(_program_t* p)
+    {
+        if (p && !--p->refs)
+        {
+            p->~_program_t();
+            MEM::deallocate(p);
+        }
+    }
+};
+
+template <class MEM> struct re_t
+{
+    typedef arena_memory_allocator_t<MEM> TMP;  // compile期间的临时结构都从内存池分配
+    typedef _arena_t<MEM> arena_t;
+    typedef _tree_t<TMP> tree_t;
+    typedef _state_t<TMP> state_t;
+    typedef array_t<state_t*, TMP> state_array_t;
+    typedef typename state_array_t::iterator_t state_iterator_t;
+    typedef stack_t<state_t*, TMP> state_stack_t;
+    typedef _state_index_t<TMP> state_index_t;
+    typedef _nfa_t<MEM> nfa_t;
+    typedef _lazy_dfa_t<MEM> lazy_dfa_t;
+    typedef _program_t<MEM> program_t;
+    typedef array_t<_delta_t, TMP> delta_array_t;
+    typedef _results_t<MEM> results_t;
+    typedef const unsigned char* (re_t::*match_fun_ptr)(const unsigned char*, const unsigned char*);
+    typedef int (re_t::*search_fun_ptr)(const unsigned char*, const unsigned char*, results_t&, long);
+    typedef const unsigned char* (re_t::*search_prefix_fun_ptr)(const unsigned char*, const unsigned char*);
+    typedef typename _results_t<MEM>::iterator_t result_iterator_t;
+
+    // 选定的搜索函数, results_t以外的SINK按它分派到对应的实例, 见__search_by
+    enum engine_t
+    {
+        ENGINE_SAMPLE,
+        ENGINE_WITH_PREFIX_BTHR,
+        ENGINE_WITHOUT_PREFIX_BTHR,
+        ENGINE_WORD_BTHR,
+        ENGINE_WITH_PREFIX_ATHR,
+        ENGINE_WITHOUT_PREFIX_ATHR,
+        ENGINE_WORD_ATHR,
+        ENGINE_LAZY,
+        ENGINE_WORD_LAZY,
+        ENGINE_REVERSE,
+        ENGINE_BITS,
+        ENGINE_VM,
+        ENGINE_WITH_LITERAL
+    };
+    typedef typename _results_t<MEM>::const_iterator_t const_result_iterator_t;
+
+    program_t* _prog;         // 以下各表的所有者
+    char* _exp;
+    size_t _explen;
+    size_t _num;
+    bool* _accept;
+    unsigned char* _trans;
+    U16* _wtrans;       // 16位状态转移表, 状态数超过THR时使用
+    unsigned char* _classes;  // 输入字节到等价类的映射, 转移表每行 1 << _cshift 列
+    lazy_dfa_t* _lazy;        // LAZY_DFA模式下的状态缓存
+    lazy_dfa_t* _fwd;         // 三段式搜索: 以.*开头的正向自动机
+    lazy_dfa_t* _rev;         // 三段式搜索: 反向自动机
+    lazy_dfa_t* _anc;         // 三段式搜索: 从确定的起点求最长匹配的正向自动机
+    lazy_dfa_t* _rrev;        // 线性模式: 右端不锚定的反向自动机
+    _bit_nfa_t* _bits;        // 位并行模式: [0]锚定的正向, [1]以.*开头的正向, [2]反向, DFA模式下作为子集爆炸时的备用
+    _pike_vm_t<MEM>* _vm;     // NFA模拟模式: 与_bits相同, 有$时[2]是右端锚定的反向, [1]不用; 也可作为备用
+    _pike_run_t<MEM>* _run;   // _vm的工作区, 不共享
+    _submatch_t<MEM>* _sub;   // 捕获分组, 第一次用到时编译, 不共享
+    size_t _ngroups;
+    _start_scanner_t _scanner;  // 查找可以作为匹配起点的字节
+    unsigned char* _prefix;
+    size_t _prelen;
+    unsigned char* _pretable;
+    unsigned char* _window;   // 匹配中可能出现的字节, 在_prefix为必含字面串时划定搜索窗口
+    match_fun_ptr _match_fun;
+    search_fun_ptr _search_fun;
+    engine_t _engine;         // 与_search_fun一致, 由__set_engine同时设置
+    engine_t _window_engine;  // ENGINE_WITH_LITERAL时各窗口内使用的搜索函数
+    search_prefix_fun_ptr _search_prefix_fun;
+    search_prefix_fun_ptr _start_fun;
+    size_t _maxlen;           // 匹配的最大长度, 可为UNBOUNDED
+    size_t _maxstates;        // 编译预算, 见set_compile_budget
+    size_t _maxbytes;
+
+    bool _ignorecase, _matchword, _badcharopt, _lazydfa, _linearsearch, _bitparallel, _pikevm;
+    bool matchbegin, matchend, matchmin;
+    unsigned char _cmin, _cmax;
+    unsigned char _cshift;
+
+    re_t()
+    {
+        memset(this, 0, sizeof(re_t));
+    }
+
+    re_t(const char* exp, long flag = 0)
+    {
+        memset(this, 0, sizeof(re_t));
+        if (exp)
+        {
+            __set_exp(exp, strlen(exp), flag);
+        }
+    }
+
+    re_t(const char* exp, size_t explen, long flag = 0)
+    {
+        memset(this, 0, sizeof(re_t));
+        if (exp)
+        {
+            __set_exp(exp, explen, flag);
+        }
+    }
+
+    /*
+     * 复制与原对象共享编译结果, 只另建惰性DFA的状态缓存,
+     * 原对象正在其他线程中搜索时也可以复制, 复制所得的对象各自在一个线程中使用
+     */
+    re_t(const re_t& another)
+    {
+        __share(another);
+    }
+
+#ifdef _RE_THREADS
+    re_t(re_t&& another)
+    {
+        memcpy((void*)this, (const void*)&another, sizeof(re_t));
+        memset((void*)&another, 0, sizeof(re_t));
+    }
+#endif
+
+    ~re_t()
+    {
+        release();
+    }
+
+    re_t& operator =(const re_t& another)
+    {
+        if (this != &another)
+        {
+            release();
+            __share(another);
+        }
+        return *this;
+    }
+
+    error_t compile()
+    {
+        __unshare();
+        error_t ret = __compile();
+        __publish();
+        return ret;
+    }
+
+    error_t __compile()
+    {
+        arena_t arena;  // 语法树和子集构造的临时状态在返回时随内存池一起释放
+        tree_t tree(_exp, _explen);
+        error_t ret = __build_tree(tree);
+
+        if (ret == NO_ERR)
+        {
+            /*
+             * 子集构造超出预算时, 位置够少的改用位并行模拟, 否则改用NFA模拟;
+             * 没有设置预算时位并行的预算是BIT_NFA_STATES个状态, NFA模拟的是MAX_STATES
+             */
+            bool bits = __bits_fit(tree);
+            bool vm = !_matchword && !_badcharopt;
+            _bitparallel = _bitparallel && bits && !_lazydfa;
+            _pikevm = _pikevm && vm && !_lazydfa && !_bitparallel;
+            if (_lazydfa)
+            {
+                __generate_lazy_DFA(tree);
+                __deal_with_reverse(tree);
+                __deal_with_literal(tree);
+                return ret;
+            }
+            if (_bitparallel)
+            {
+                __generate_bits(tree);
+                return ret;
+            }
+            if (_pikevm)
+            {
+                __generate_vm(tree);
+                return ret;
+            }
+            __generate_classes(tree);
+            state_array_t states;
+            if ((ret = __generate_states(tree, states, __state_budget(bits))) != NO_ERR)
+            {
+                if (ret == ERR_TOO_MUCH_STATUS && (bits || vm))
+                {
+                    if (bits)
+                    {
+                        _bitparallel = true;
+                        __generate_bits(tree);
+                    }
+                    else
+                    {
+                        _pikevm = true;
+                        __generate_vm(tree);
+                    }
+                    ret = NO_ERR;
+                }
+                return ret;
+            }
+            __set_acceptions(states, tree);
+            __sort_states(states);
+            if (__deal_with_prefix(states))
+            {
+                _num = 0;  // 整个表达式是字面串, 不生成转移表, deserialize和generate_code据此判断
+                _match_fun = &re_t::__match_sample;
+                __set_engine(ENGINE_SAMPLE);
+            }
+            else
+            {
+                if (_num <= THR)
+                {
+                    __generate_DFA_bthr(states, tree);
+                }
+                else
+                {
+                    __generate_DFA_athr(states, tree);
+                }
+                __select_engine(tree);
+            }
+
+            for (state_iterator_t i = states.begin(); i != states.end(); i++)
+            {
+    #ifdef _RE_DEBUG
+                __debug_state(i);
+    #endif
+                state_t::release(*i);
+            }
+        }
+        return ret;
+    }
+
+    error_t __build_tree(tree_t& tree)
+    {
+        error_t ret = tree.build();
+        if (ret == NO_ERR)
+        {
+            if (_ignorecase)
+            {
+                tree.ignore_case();
+            }
+    #ifdef _RE_DEBUG
+            tree.debug();
+    #endif
+            matchbegin = tree.matchbegin;
+            matchend = tree.matchend;
+            _maxlen = tree.max_length();
+            _ngroups = tree.ngroups;
+        }
+        return ret;
+    }
+
+    // 转移表已经生成(或从映像载入)之后, 选择匹配和搜索函数, 生成只依赖语法树的辅助结构
+    void __select_engine(tree_t& tree)
+    {
+        __generate_scanner(tree);
+        if (_num <= THR)
+        {
+            if (_matchword)
+            {
+                _match_fun = &re_t::__match_word_bthr;
+                __set_engine(ENGINE_WORD_BTHR);
+            }
+            else
+            {
+                _match_fun = &re_t::__match_bthr;
+                __set_engine(_prefix? ENGINE_WITH_PREFIX_BTHR: ENGINE_WITHOUT_PREFIX_BTHR);
+            }
+        }
+        else
+        {
+            if (_matchword)
+            {
+                _match_fun = &re_t::__match_word_athr;
+                __set_engine(ENGINE_WORD_ATHR);
+            }
+            else
+            {
+                _match_fun = &re_t::__match_athr;
+                __set_engine(_prefix? ENGINE_WITH_PREFIX_ATHR: ENGINE_WITHOUT_PREFIX_ATHR);
+            }
+        }
+        __deal_with_reverse(tree);
+        if (_fwd && __bits_fit(tree))
+        {
+            __generate_bit_tables(tree);  // 备用, 见__first_end
+        }
+        else if (_fwd)
+        {
+            __generate_vm_tables(tree);
+        }
+        __deal_with_literal(tree);
+    }
+
+    error_t compile(const char* exp, size_t explen, long flag = 0)
+    {
+        size_t states = _maxstates, bytes = _maxbytes;
+        release();
+        _maxstates = states;
+        _maxbytes = bytes;
+        if (exp)
+        {
+            __set_exp(exp, _explen = explen, flag);
+            return compile();
+        }
+        return ERR_EMP;
+    }
+
+    error_t compile(const char* exp, long flag = 0)
+    {
+        return compile(exp, strlen(exp), flag);
+    }
+
+    const unsigned char* match(const unsigned char* p, const unsigned char* e)
+    {
+        return (this->*_match_fun)(p, e);
+    }
+
+    const char* match(const char* p, const char* e)
+    {
+        return (const char*)(this->*_match_fun)((const unsigned char*)p, (const unsigned char*)e);
+    }
+
+    const char* match(const char* p)
+    {
+        return (const char*)(this->*_match_fun)((const unsigned char*)p, (const unsigned char*)(p + strlen(p)));
+    }
+
+    size_t search(const unsigned char* p, const unsigned char* e, results_t& results, long n = SEARCH_FIRST)
+    {
+        size_t s0 = results.size();
+        __search(p, e, results, n);
+        return results.size() - s0;
+    }
+
+    size_t search(const char* p, const char* e, results_t& results, long n = SEARCH_FIRST)
+    {
+        return search((const unsigned char*)p, (const unsigned char*)e, results, n);
+    }
+
+    size_t search(const char* p, results_t& results, long n = SEARCH_FIRST)
+    {
+        return search((const unsigned char*)p, (const unsigned char*)(p + strlen(p)), results, n);
+    }
+
+    /*
+     * 结果交给sink.put(p, e)而不存入results_t, 例如count_sink_t, span_sink_t,
+     * put返回false时停止. 返回交给sink的匹配个数
+     */
+    template <class SINK> size_t search_into(const unsigned char* p, const unsigned char* e, SINK& sink, long n = SEARCH_ALL)
+    {
+        _counted_sink_t<SINK> counted(sink);
+        __search(p, e, counted, n);
+        return counted.count;
+    }
+
+    template <class SINK> size_t search_into(const char* p, const char* e, SINK& sink, long n = SEARCH_ALL)
+    {
+        return search_into((const unsigned char*)p, (const unsigned char*)e, sink, n);
+    }
+
+    // 每个匹配调用一次f(p, e), f返回false时停止
+    template <class F> size_t search_each(const unsigned char* p, const unsigned char* e, F f, long n = SEARCH_ALL)
+    {
+        _callback_sink_t<F> sink(f);
+        return search_into(p, e, sink, n);
+    }
+
+    template <class F> size_t search_each(const char* p, const char* e, F f, long n = SEARCH_ALL)
+    {
+        return search_each((const unsigned char*)p, (const unsigned char*)e, f, n);
+    }
+
+    /*
+     * 是否有匹配. 有_fwd时正向扫描一遍, 到达接受状态即返回, 不求匹配的起点和最长的结尾;
+     * 文字窗口模式只扫描各窗口. 单词模式, MATCH_END和BAD_CHAR_OPT时退化为search.
+     * 找到第一个结尾的扫描与search相同, 只在匹配很长时更快
+     */
+    bool contains(const unsigned char* p, const unsigned char* e)
+    {
+        if (!_fwd || p == e)
+        {
+            _count_sink_t sink;
+            __search(p, e, sink, SEARCH_FIRST);
+            return sink.count != 0;
+        }
+        if (matchbegin)
+        {
+            size_t s = 0;
+            while (p != e && (s = _anc->next(s, *p++)) != lazy_dfa_t::DEAD)
+            {
+                if (_anc->_accept[s])
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+        if (_engine != ENGINE_WITH_LITERAL)
+        {
+            return __first_end(p, e) != NULL;
+        }
+        const unsigned char *h, *a, *b;
+        while ((h = (this->*_search_prefix_fun)(p, e)))
+        {
+            a = h;
+            b = h + _prelen;
+            while (a != p && _window[a[-1]])
+            {
+                a--;
+            }
+            while (b != e && _window[*b])
+            {
+                b++;
+            }
+            if (__first_end(a, b))
+            {
+                return true;
+            }
+            p = b;
+        }
+        return false;
+    }
+
+    bool contains(const char* p, const char* e)
+    {
+        return contains((const unsigned char*)p, (const unsigned char*)e);
+    }
+
+    bool contains(const char* p)
+    {
+        return contains((const unsigned char*)p, (const unsigned char*)(p + strlen(p)));
+    }
+
+    /*
+     * 匹配个数, 与search(..., SEARCH_ALL)的结果个数相同, 但不保存匹配.
+     * 下一个匹配从上一个的最长结尾开始找, 而最长结尾取决于最左的起点,
+     * 所以每个匹配的两端仍要求出, 与search走同样的搜索函数, 只省去保存结果
+     */
+    size_t count(const unsigned char* p, const unsigned char* e)
+    {
+        _count_sink_t sink;
+        __search(p, e, sink, SEARCH_ALL);
+        return sink.count;
+    }
+
+    size_t count(const char* p, const char* e)
+    {
+        return count((const unsigned char*)p, (const unsigned char*)e);
+    }
+
+    size_t count(const char* p)
+    {
+        return count((const unsigned char*)p, (const unsigned char*)(p + strlen(p)));
+    }
+
+    // 表达式中的分组个数, 即左括号的个数
+    size_t group_count() const
+    {
+        return _ngroups;
+    }
+
+    /*
+     * [p, e)须是本表达式的一个匹配, 如search的结果. 求各分组在其中的位置,
+     * spans[0]为[p, e), spans[g]为第g个分组, 共group_count() + 1个; 没有参与匹配的分组为[NULL, NULL).
+     * 分组的取法与回溯引擎在[p, e)上的第一个解相同. [p, e)不是匹配时返回false
+     */
+    bool submatch(const unsigned char* p, const unsigned char* e, _result_t* spans)
+    {
+        return __submatch_program() && _sub->run(p, e, spans);
+    }
+
+    bool submatch(const char* p, const char* e, _result_t* spans)
+    {
+        return submatch((const unsigned char*)p, (const unsigned char*)e, spans);
+    }
+
+    // 每个匹配在results中依次存入group_count() + 1项, 含义同submatch. 返回匹配个数
+    size_t search_groups(const unsigned char* p, const unsigned char* e, results_t& results, long n = SEARCH_FIRST)
+    {
+        if (matchbegin && !_matchword && !matchmin && n && __submatch_program())
+        {
+            // 锚定在开头时从p扫描一遍即得到最长的匹配和各分组, 不必先搜索
+            size_t k = results.size();
+            for (size_t i = 0; i <= _ngroups; i++)
+            {
+                results.append(_result_t());
+            }
+            _result_t* spans = results.begin() + k;
+            const unsigned char* end = matchend? (_sub->run(p, e, spans)? e: NULL): _sub->longest(p, e, spans);
+            if (end && end != p)
+            {
+                return 1;
+            }
+            while (results.size() > k)
+            {
+                results.pop_back();
+            }
+            return 0;
+        }
+        _group_sink_t sink(*this, results);
+        __search(p, e, sink, n);
+        return sink.count;
+    }
+
+    size_t search_groups(const char* p, const char* e, results_t& results, long n = SEARCH_FIRST)
+    {
+        return search_groups((const unsigned char*)p, (const unsigned char*)e, results, n);
+    }
+
+    size_t search_groups(const char* p, results_t& results, long n = SEARCH_FIRST)
+    {
+        return search_groups((const unsigned char*)p, (const unsigned char*)(p + strlen(p)), results, n);
+    }
+
+    // 第一次用到时编译捕获分组
+    _submatch_t<MEM>* __submatch_program()
+    {
+        if (!_sub)
+        {
+            arena_t arena;
+            tree_t tree(_exp, _explen);
+            if (tree.build() != NO_ERR)
+            {
+                return NULL;
+            }
+            if (_ignorecase)
+            {
+                tree.ignore_case();
+            }
+            _sub = _submatch_t<MEM>::create();
+            _sub->build(tree);
+        }
+        return _sub;
+    }
+
+    struct _group_sink_t
+    {
+        re_t& re;
+        results_t& results;
+        size_t count;
+
+        _group_sink_t(re_t& x, results_t& y): re(x), results(y), count(0)
+        {}
+
+        bool put(const unsigned char* p, const unsigned char* e)
+        {
+            size_t k = results.size();
+            for (size_t i = 0; i <= re._ngroups; i++)
+            {
+                results.append(_result_t());
+            }
+            if (!re.submatch(p, e, results.begin() + k))
+            {
+                results[k] = _result_t(p, e);
+            }
+            count++;
+            return true;
+        }
+    };
+
+    #define __memchr(p, ch, len) (const unsigned char*)memchr((p), (ch), (len))
+
+    /*
+     * 按sep分行搜索, 匹配不跨行, sep可以是任意长度.
+     * 有每个匹配都必须包含的字面串(_prefix)时先查找它, 只搜索含有它的行, 其余的行不调用__search
+     */
+    size_t search_lines(const unsigned char* p, const unsigned char* e, results_t& results, long n = SEARCH_FIRST, const char* sep = "\n")
+    {
+        _sep_finder_t finder(sep);
+        size_t s0 = results.size(), s = s0;
+        const unsigned char *q, *h = NULL;
+        while (p < e)
+        {
+            if (_prefix)
+            {
+                if (!(h = (this->*_search_prefix_fun)(p, e)))
+                {
+                    break;
+                }
+                p = __line_start(finder, p, h);
+            }
+            q = finder.find(p, e);
+            if (!h || h + _prelen <= (q? q: e))  // 字面串跨过了分隔符时这一行不会有匹配
+            {
+                if (__search(p, q? q: e, results, n) == RESULTS_ENOUGH)
+                {
+                    break;
+                }
+                n -= results.size() - s;
+                s = results.size();
+            }
+            if (!q)
+            {
+                break;
+            }
+            p = q + finder.len;
+        }
+        return results.size() - s0;
+    }
+
+    // 从行首p出发, 包含h的一行的行首. 分隔符不会自身重叠时从h向左找, 否则只能从p向右切分
+    static const unsigned char* __line_start(const _sep_finder_t& finder, const unsigned char* p, const unsigned char* h)
+    {
+        const unsigned char* q;
+        size_t len = finder.len;
+        if (!finder.overlap)
+        {
+            unsigned char last = finder.sep[len - 1];
+            while (size_t(h - p) >= len && (h[-1] != last || memcmp(h - len, finder.sep, len - 1)))
+            {
+                h--;
+            }
+            return size_t(h - p) >= len? h: p;
+        }
+        while ((q = finder.find(p, h)))
+        {
+            p = q + len;
+        }
+        return p;
+    }
+
+    size_t search_lines(const char* p, const char* e, results_t& results, long n = SEARCH_FIRST, const char* sep = "\n")
+    {
+        return search_lines((const unsigned char*)p, (const unsigned char*)e, results, n, sep);
+    }
+
+    size_t search_lines(const char* p, results_t& results, long n = SEARCH_FIRST, const char* sep = "\n")
+    {
+        return search_lines((const unsigned char*)p, (const unsigned char*)(p + strlen(p)), results, n, sep);
+    }
+
+    /*
+     * 搜索文件, sep为NULL时整体搜索, 否则按sep分行搜索, 结果为相对文件开头的偏移.
+     * 普通文件用mmap映射后直接搜索, 管道等不能映射的文件用read分块读入,
+     * 整体搜索时经由stream_t, 分行搜索时只保留最后不完整的一行
+     */
+    error_t search_file(const char* path, _offset_results_t<MEM>& results, long n = SEARCH_FIRST, const char* sep = NULL)
+    {
+    #ifdef _RE_POSIX_IO
+        int fd = open(path, O_RDONLY);
+        if (fd < 0)
+        {
+            return ERR_FILE;
+        }
+        error_t ret = __search_fd(fd, results, n, sep);
+        close(fd);
+        return ret;
+    #else
+        FILE* fp = fopen(path, "rb");
+        if (!fp)
+        {
+            return ERR_FILE;
+        }
+        error_t ret = __search_file_by_read(fp, results, n, sep);
+        fclose(fp);
+        return ret;
+    #endif
+    }
+
+#ifdef _RE_POSIX_IO
+    error_t __search_fd(int fd, _offset_results_t<MEM>& results, long n, const char* sep)
+    {
+        struct stat st;
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+        {
+            size_t size = (size_t)st.st_size;
+            void* addr = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr != MAP_FAILED)
+            {
+                const unsigned char* p = (const unsigned char*)addr;
+                results_t tmp;
+            #ifdef MADV_SEQUENTIAL
+                madvise(addr, size, MADV_SEQUENTIAL);
+            #endif
+                if (sep)
+                {
+                    search_lines(p, p + size, tmp, n, sep);
+                }
+                else
+                {
+                    search(p, p + size, tmp, n);
+                }
+                for (_result_t* i = tmp.begin(); i != tmp.end(); i++)
+                {
+                    results.append(_offset_result_t(i->p - p, i->e - p));
+                }
+                munmap(addr, size);
+                return NO_ERR;
+            }
+        }
+        return __search_file_by_read(fd, results, n, sep);
+    }
+
+    static long __read_chunk(int fd, unsigned char* buf, size_t size)
+    {
+        return (long)read(fd, buf, size);
+    }
+#endif
+
+    static long __read_chunk(FILE* fp, unsigned char* buf, size_t size)
+    {
+        size_t r = fread(buf, 1, size, fp);
+        return r || !ferror(fp)? (long)r: -1;
+    }
+
+    template <class SOURCE> error_t __search_file_by_read(SOURCE src, _offset_results_t<MEM>& results, long n, const char* sep)
+    {
+        const size_t CHUNK = 1 << 16;
+        size_t s0 = results.size(), len = 0, cap = CHUNK, off = 0, seplen = sep? strlen(sep): 0;
+        unsigned char* buf = (unsigned char*)MEM::allocate(cap);
+        _stream_t<MEM> stream(*this);
+        results_t tmp;
+        error_t ret = NO_ERR;
+        long r = 0;
+        while (n < 0 || results.size() - s0 < size_t(n))
+        {
+            if (cap - len < CHUNK)
+            {
+                buf = (unsigned char*)MEM::reallocate(cap <<= 1, buf);
+            }
+            if ((r = __read_chunk(src, buf + len, CHUNK)) <= 0)
+            {
+                break;
+            }
+            if (!sep)
+            {
+                stream.feed(buf, buf + r, results);
+                continue;
+            }
+            // 只搜索到最后一个分隔符为止, 其后不完整的一行留到下次
+            const unsigned char* q = __last_linesep(buf + (len >= seplen? len - seplen + 1: 0), buf + len + r, sep, seplen);
+            len += r;
+            if (q)
+            {
+                q += seplen;
+                __search_lines_at(buf, q, off, tmp, results, n - (results.size() - s0), sep);
+                off += q - buf;
+                len -= q - buf;
+                memmove(buf, q, len);
+            }
+        }
+        if (r < 0)
+        {
+            ret = ERR_FILE;
+        }
+        else if (!sep)
+        {
+            stream.finish(results);
+        }
+        else if (len && (n < 0 || results.size() - s0 < size_t(n)))
+        {
+            __search_lines_at(buf, buf + len, off, tmp, results, n - (results.size() - s0), sep);
+        }
+        while (n > 0 && results.size() - s0 > size_t(n))
+        {
+            results.pop_back();
+        }
+        MEM::deallocate(buf);
+        return ret;
+    }
+
+    void __search_lines_at(const unsigned char* p, const unsigned char* e, size_t off,
+                           results_t& tmp, _offset_results_t<MEM>& results, long n, const char* sep)
+    {
+        tmp.clear();
+        search_lines(p, e, tmp, n, sep);
+        for (_result_t* i = tmp.begin(); i != tmp.end(); i++)
+        {
+            results.append(_offset_result_t(off + (i->p - p), off + (i->e - p)));
+        }
+    }
+
+    /*
+     * 多线程搜索, 结果与search或search_lines(sep不为NULL时)相同. nthreads为0时取CPU核数.
+     * 按行搜索时各块在分隔符之后切分; 整体搜索时要求匹配长度有上限, 各块向后多搜索该长度,
+     * 合并时若上一块的匹配越过了块边界, 则从其结尾重新搜索, 直到与本块的结果重合.
+     * 编译出的表只读共享, 惰性DFA由每个线程各自复制一份
+     */
+    size_t search_parallel(const unsigned char* p, const unsigned char* e, results_t& results,
+                           long n = SEARCH_FIRST, const char* sep = NULL, size_t nthreads = 0)
+    {
+        size_t s0 = results.size();
+        size_t k = __parallel_chunks(p, e, sep, nthreads);
+        if (k < 2)
+        {
+            sep? search_lines(p, e, results, n, sep): search(p, e, results, n);
+            return results.size() - s0;
+        }
+        _parallel_task_t task;
+        task.re = this;
+        task.sep = sep;
+        task.n = n;
+        task.num = k;
+        task.bounds = (const unsigned char**)MEM::allocate((k + 1) * sizeof(const unsigned char*));
+        task.parts = (results_t*)MEM::allocate(k * sizeof(results_t));
+        task.next = 0;
+        size_t step = (e - p) / k;
+        _sep_finder_t finder(sep);
+        task.bounds[0] = p;
+        task.bounds[k] = e;
+        for (size_t i = 1; i < k; i++)
+        {
+            const unsigned char* b = p + step * i;
+            if (sep)
+            {
+                b = (b = finder.find(b, e))? b + finder.len: e;
+            }
+            task.bounds[i] = b > task.bounds[i - 1]? b: task.bounds[i - 1];
+        }
+        for (size_t i = 0; i < k; i++)
+        {
+            ::new (task.parts + i) results_t();
+        }
+        __run_parallel(task, nthreads < k? nthreads: k);
+        const unsigned char* last = p;
+        for (size_t i = 0; i < k && (n < 0 || results.size() - s0 < size_t(n)); i++)
+        {
+            last = __merge_chunk(task, i, last, results);
+        }
+        while (n > 0 && results.size() - s0 > size_t(n))
+        {
+            results.pop_back();
+        }
+        for (size_t i = 0; i < k; i++)
+        {
+            task.parts[i].~results_t();
+        }
+        MEM::deallocate(task.parts);
+        MEM::deallocate(task.bounds);
+        return results.size() - s0;
+    }
+
+    size_t search_parallel(const char* p, const char* e, results_t& results,
+                           long n = SEARCH_FIRST, const char* sep = NULL, size_t nthreads = 0)
+    {
+        return search_parallel((const unsigned char*)p, (const unsigned char*)e, results, n, sep, nthreads);
+    }
+
+    struct _parallel_task_t
+    {
+        re_t* re;
+        const char* sep;
+        long n;
+        size_t num;
+        const unsigned char** bounds;
+        results_t* parts;
+    #ifdef _RE_THREADS
+        std::atomic<size_t> next;
+    #else
+        size_t next;
+    #endif
+    };
+
+    // 块数, 不足2块时串行搜索
+    size_t __parallel_chunks(const unsigned char* p, const unsigned char* e, const char* sep, size_t& nthreads)
+    {
+    #ifdef _RE_THREADS
+        if (!nthreads)
+        {
+            nthreads = std::thread::hardware_concurrency();
+        }
+        if (nthreads < 2 || matchbegin)
+        {
+            return 0;
+        }
+        if (sep)
+        {
+            if (_sep_finder_t::overlapping(sep))
+            {
+                return 0;  // 自身重叠的分隔符从块中间查找时可能与从头切分的结果不同
+            }
+        }
+        else if (_maxlen == UNBOUNDED || _matchword || matchend)
+        {
+            return 0;
+        }
+        size_t k = (e - p) / PARALLEL_CHUNK_MIN;
+        return k < nthreads * 4? k: nthreads * 4;
+    #else
+        return 0;
+    #endif
+    }
+
+    void __run_parallel(_parallel_task_t& task, size_t nthreads)
+    {
+    #ifdef _RE_THREADS
+        std::thread* threads = (std::thread*)MEM::allocate(nthreads * sizeof(std::thread));
+        for (size_t i = 1; i < nthreads; i++)
+        {
+            ::new (threads + i) std::thread(&re_t::__parallel_worker, &task);
+        }
+        __parallel_worker(&task);
+        for (size_t i = 1; i < nthreads; i++)
+        {
+            threads[i].join();
+            threads[i].~thread();
+        }
+        MEM::deallocate(threads);
+    #endif
+    }
+
+    static void __parallel_worker(_parallel_task_t* task)
+    {
+        re_t re(*task->re);
+        size_t i;
+        while ((i = task->next++) < task->num)
+        {
+            const unsigned char* b = task->bounds[i];
+            const unsigned char* t = task->bounds[i + 1];
+            if (task->sep)
+            {
+                re.search_lines(b, t, task->parts[i], task->n, task->sep);
+            }
+            else
+            {
+                re.__search(b, re.__window_end(t, task->bounds[task->num]), task->parts[i], task->n);
+            }
+        }
+    }
+
+    // 起点在t之前的匹配可能延伸到的位置
+    const unsigned char* __window_end(const unsigned char* t, const unsigned char* e) const
+    {
+        return size_t(e - t) > _maxlen? t + _maxlen: e;
+    }
+
+    // 按行搜索时各块互不影响; 整体搜索时只取起点在块内的匹配, 必要时从last开始重新同步
+    const unsigned char* __merge_chunk(_parallel_task_t& task, size_t i, const unsigned char* last, results_t& results)
+    {
+        results_t& part = task.parts[i];
+        const unsigned char* b = task.bounds[i];
+        const unsigned char* t = task.bounds[i + 1];
+        const unsigned char* w = __window_end(t, task.bounds[task.num]);
+        _result_t* r = part.begin();
+        if (!task.sep && last > b)
+        {
+            results_t one;
+            for (;;)
+            {
+                one.clear();
+                if (last >= t || (__search(last, w, one, 1), !one.size()) || one[0].p >= t)
+                {
+                    return last;
+                }
+                while (r != part.end() && r->p < one[0].p)
+                {
+                    r++;
+                }
+                if (r != part.end() && r->p == one[0].p && r->e == one[0].e)
+                {
+                    break;
+                }
+                results.append(one[0]);
+                last = one[0].e;
+            }
+        }
+        for (; r != part.end() && (task.sep || r->p < t); r++)
+        {
+            results.append(*r);
+            last = r->e;
+        }
+        return last;
+    }
+
+    static const unsigned char* __last_linesep(const unsigned char* p, const unsigned char* e, const char* sep, size_t seplen)
+    {
+        const unsigned char* q = e - seplen;
+        while (q >= p && memcmp(q, sep, seplen))
+        {
+            q--;
+        }
+        return q >= p? q: NULL;
+    }
+
+    bool accept_empty() const
+    {
+        return _lazy? _lazy->_accept[0]: _accept[0];
+    }
+
+    /*
+     * 把编译结果写入buf, 返回映像长度; 长度超过cap时不写入, 未编译时返回0.
+     * 映像与编译时所用的本库版本和字节序相关, 载入时检查
+     */
+    size_t serialize(void* buf, size_t cap) const
+    {
+        if (!_match_fun)
+        {
+            return 0;
+        }
+        _image_header_t h;
+        size_t preoff, clsoff, accoff, transoff;
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, "MYRE", 4);
+        h.version = IMAGE_VERSION;
+        h.order = 0x0102;
+        h.flag = (U32)__get_flag();
+        h.explen = (U32)_explen;
+        if (!_lazydfa && !_bitparallel && !_pikevm)
+        {
+            h.num = (U32)_num;
+            h.cshift = _cshift;
+            h.sample = _match_fun == &re_t::__match_sample;
+            h.prelen = _window? 0: (U32)_prelen;  // 有_window时_prefix是必含字面串, 载入时重新求出
+        }
+        size_t size = h.layout(preoff, clsoff, accoff, transoff);
+        if (size > cap)
+        {
+            return size;
+        }
+        unsigned char* p = (unsigned char*)buf;
+        memset(p, 0, size);
+        memcpy(p + sizeof(h), _exp, _explen);
+        if (h.prelen)
+        {
+            memcpy(p + preoff, _prefix, h.prelen);
+        }
+        if (accoff != clsoff)
+        {
+            memcpy(p + clsoff, _classes, 256);
+            memcpy(p + accoff, _accept, _num);
+            if (_num <= THR)
+            {
+                memcpy(p + transoff, _trans, _num << _cshift);
+            }
+            else
+            {
+                memcpy(p + transoff, _wtrans, (_num << _cshift) * sizeof(U16));
+            }
+        }
+        h.size = (U32)size;
+        h.checksum = _image_header_t::fnv1a(p + sizeof(h), p + size);
+        memcpy(p, &h, sizeof(h));
+        return size;
+    }
+
+    /*
+     * 从serialize生成的映像恢复, 跳过子集构造, 只重新解析表达式.
+     * 转移表, 接受表和等价类直接使用data中的数据, data须在本对象及其副本释放前保持有效,
+     * 并按8字节对齐(16位的转移表直接按U16读取), 否则返回ERR_IMAGE
+     */
+    error_t deserialize(const void* data, size_t len)
+    {
+        release();
+        const unsigned char* p = (const unsigned char*)data;
+        _image_header_t h;
+        size_t preoff, clsoff, accoff, transoff;
+        if (len < sizeof(h) || ((size_t)p & 7))
+        {
+            return ERR_IMAGE;
+        }
+        memcpy(&h, p, sizeof(h));
+        if (memcmp(h.magic, "MYRE", 4) || h.version != IMAGE_VERSION || h.order != 0x0102 ||
+            h.size > len || h.cshift > 8 || h.num > MAX_STATES || h.prelen > 256 ||
+            (!h.sample && h.num && h.prelen >= h.num) ||
+            h.layout(preoff, clsoff, accoff, transoff) != h.size ||
+            h.checksum != _image_header_t::fnv1a(p + sizeof(h), p + h.size))
+        {
+            return ERR_IMAGE;
+        }
+        __set_exp((const char*)p + sizeof(h), h.explen, h.flag);
+        if (_lazydfa || _bitparallel || _pikevm)
+        {
+            return compile();
+        }
+        arena_t arena;
+        tree_t tree(_exp, _explen);
+        error_t ret = __build_tree(tree);
+        if (ret != NO_ERR)
+        {
+            release();
+            return ret;
+        }
+        if (h.sample)
+        {
+            _prelen = h.prelen;
+            __set_prefix(p + preoff);
+            _match_fun = &re_t::__match_sample;
+            __set_engine(ENGINE_SAMPLE);
+        }
+        else
+        {
+            _num = h.num;
+            _cshift = h.cshift;
+            _classes = (unsigned char*)(p + clsoff);
+            _accept = (bool*)(p + accoff);
+            if (_num <= THR)
+            {
+                _trans = (unsigned char*)(p + transoff);
+            }
+            else
+            {
+                _wtrans = (U16*)(p + transoff);
+            }
+            if (!_num || !__check_tables())
+            {
+                release();
+                return ERR_IMAGE;
+            }
+            if (_matchword)
+            {
+                __generate_bound_table();
+            }
+            else
+            {
+                _prelen = h.prelen;
+                __set_prefix(p + preoff);
+                if (!__check_prefix())
+                {
+                    release();
+                    return ERR_IMAGE;
+                }
+            }
+            __select_engine(tree);
+        }
+        __publish();
+        _prog->classes = NULL;  // 以下指向映像, 不由_prog释放
+        _prog->accept = NULL;
+        _prog->trans = NULL;
+        _prog->wtrans = NULL;
+        return NO_ERR;
+    }
+
+    error_t save(const char* path) const
+    {
+        size_t size = serialize(NULL, 0);
+        if (!size)
+        {
+            return ERR_IMAGE;
+        }
+        void* buf = MEM::allocate(size);
+        serialize(buf, size);
+        FILE* fp = fopen(path, "wb");
+        error_t ret = fp && fwrite(buf, 1, size, fp) == size? NO_ERR: ERR_FILE;
+        if (fp && fclose(fp))
+        {
+            ret = ERR_FILE;
+        }
+        MEM::deallocate(buf);
+        return ret;
+    }
+
+    // 载入save保存的映像文件, 可以映射时直接使用映射的内存
+    error_t load(const char* path)
+    {
+        void* image = NULL;
+        size_t size = 0;
+        bool mapped = false;
+    #ifdef _RE_POSIX_IO
+        int fd = open(path, O_RDONLY);
+        struct stat st;
+        if (fd < 0)
+        {
+            return ERR_FILE;
+        }
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+        {
+            size = (size_t)st.st_size;
+            image = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            mapped = image != MAP_FAILED;
+        }
+        close(fd);
+        if (!mapped)
+        {
+            return ERR_FILE;
+        }
+    #else
+        FILE* fp = fopen(path, "rb");
+        if (!fp)
+        {
+            return ERR_FILE;
+        }
+        if (fseek(fp, 0, SEEK_END) == 0 && (long)(size = ftell(fp)) > 0 && fseek(fp, 0, SEEK_SET) == 0)
+        {
+            image = MEM::allocate(size);
+            if (fread(image, 1, size, fp) != size)
+            {
+                MEM::deallocate(image);
+                image = NULL;
+            }
+        }
+        fclose(fp);
+        if (!image)
+        {
+            return ERR_FILE;
+        }
+    #endif
+        error_t ret = deserialize(image, size);
+        if (ret != NO_ERR)
+        {
+        #ifdef _RE_POSIX_IO
+            munmap(image, size);
+        #else
+            MEM::deallocate(image);
+        #endif
+            return ret;
+        }
+        _prog->image = image;
+        _prog->imagelen = size;
+        _prog->mapped = mapped;
+        return NO_ERR;
+    }
+
+    /*
+     * 把转移表生成为C++代码: name_match与match相同, name_search找第一个匹配.
+     * 每个状态一个标号, 转移写成对输入字节的区间比较, 区间超过GEN_RANGES个时按等价类switch.
+     * _fwd和_rev都能展开成不超过255个状态的表时, name_search与__search_reverse一样按三段式搜索,
+     * 否则逐个起点调用name_match.
+     * 需要有转移表, 不支持LAZY_DFA和单词模式
+     */
+    error_t generate_code(std::string& out, const char* name) const
+    {
+        char buf[128];
+        if (!_match_fun || !_num || _lazydfa || _matchword)
+        {
+            return NOT_SUPPORT;
+        }
+        out += "// generated by myre from: ";
+        for (size_t i = 0; i < _explen; i++)
+        {
+            unsigned char c = _exp[i];
+            snprintf(buf, sizeof(buf), c >= 0x20 && c < 0x7f? "%c": "\\x%02x", c);
+            out += buf;
+        }
+        out += "\n\nstatic inline const unsigned char* ";
+        out += name;
+        out += "_match(const unsigned char* p, const unsigned char* e)\n{\n";
+        out += "    const unsigned char* r = 0;\n";
+        std::string body;
+        bool* target = (bool*)MEM::allocate(_num * sizeof(bool));
+        bool loop = false;  // 有回到0状态的转移时需要带标号的S0, 入口处的0状态不算接受
+        for (size_t s = 0; s < _num; s++)
+        {
+            for (int c = 0; c < 256; c++)
+            {
+                loop = loop || __next_state(s, c) == 0;
+            }
+        }
+        __generate_state(body, 0, false, target);
+        for (size_t s = !loop; s < _num; s++)
+        {
+            __generate_state(body, s, true, target);
+        }
+        MEM::deallocate(target);
+        if (body.find("c = *p++;") != std::string::npos)
+        {
+            out += "    unsigned char c;\n";
+        }
+        if (body.find("switch (cls[c])") != std::string::npos)
+        {
+            out += "    static const unsigned char cls[256] = {";
+            for (int c = 0; c < 256; c++)
+            {
+                snprintf(buf, sizeof(buf), "%s%u,", c % 32? "": "\n        ", _classes[c]);
+                out += buf;
+            }
+            out += "\n    };\n";
+        }
+        out += body;
+        out += "}\n\n";
+        out += "// 找到第一个匹配时返回1, [*x, *y)为匹配的范围\n";
+        out += "static inline int ";
+        out += name;
+        out += "_search(const unsigned char* p, const unsigned char* e, const unsigned char** x, const unsigned char** y)\n{\n";
+        int first = -1;  // 只有一个起始字节时用memchr跳过
+        for (int c = 0; c < 256; c++)
+        {
+            if (__next_state(0, c) < _num)
+            {
+                first = first == -1? c: -2;
+            }
+        }
+        std::string tables;
+        if (_fwd && !matchbegin && !_accept[0] && __generate_table(tables, _fwd, "fwd") && __generate_table(tables, _rev, "rev"))
+        {
+            out += "    static const unsigned char cls[256] = {";
+            for (int c = 0; c < 256; c++)
+            {
+                snprintf(buf, sizeof(buf), "%s%u,", c % 32? "": "\n        ", _classes[c]);
+                out += buf;
+            }
+            out += "\n    };\n";
+            out += tables;
+            if (first < 0)
+            {
+                __generate_start_table(out);
+            }
+            out += "    const unsigned char *q = p, *r;\n    unsigned s = 0;\n";
+            out += "    // 最早的匹配结束位置q\n    for (;;)\n    {\n        if (s == 0)\n        {\n";
+            if (first >= 0)
+            {
+                out.insert(0, "#include <string.h>\n\n");
+                snprintf(buf, sizeof(buf), "            if (!(q = (const unsigned char*)memchr(q, 0x%02x, e - q))) return 0;\n", first);
+                out += buf;
+            }
+            else
+            {
+                out += "            while (q < e && !start[*q]) q++;\n";
+            }
+            snprintf(buf, sizeof(buf), "        }\n        if (q == e) return 0;\n        s = fwd[(s << %u) + cls[*q++]];\n", _cshift);
+            out += buf;
+            out += "        if (fwdok[s]) break;\n    }\n";
+            out += "    // 从q向左找到起点的下界r, 再从r开始找最左最长的匹配, 在q之前一定能找到\n";
+            snprintf(buf, sizeof(buf), "    r = q;\n    s = 0;\n    while (q > p && (s = rev[(s << %u) + cls[*--q]]) != 0xff)\n", _cshift);
+            out += buf;
+            out += "    {\n        if (revok[s]) r = q;\n    }\n    while (!(q = ";
+            out += name;
+            out += "_match(r, e))) r++;\n    *x = r;\n    *y = q;\n    return 1;\n}\n";
+            return NO_ERR;
+        }
+        if (first >= 0 && !matchbegin && !_accept[0])
+        {
+            out.insert(0, "#include <string.h>\n\n");
+            snprintf(buf, sizeof(buf), "    for (; p < e && (p = (const unsigned char*)memchr(p, 0x%02x, e - p)); p++)\n    {\n", first);
+            out += buf;
+            out += "        const unsigned char* r;\n";
+            out += "        if ((r = ";
+        }
+        else
+        {
+            __generate_start_table(out);
+            snprintf(buf, sizeof(buf), "    for (; p < e; p%s)\n    {\n", matchbegin? " = e": "++");
+            out += buf;
+            out += "        const unsigned char* r;\n";
+            out += "        if (start[*p] && (r = ";
+        }
+        out += name;
+        out += "_match(p, e)))\n        {\n            *x = p;\n            *y = r;\n            return 1;\n        }\n    }\n    return 0;\n}\n";
+        return NO_ERR;
+    }
+
+    void __generate_start_table(std::string& out) const
+    {
+        out += "    static const unsigned char start[256] = {";
+        for (int c = 0; c < 256; c++)
+        {
+            out += c % 32? "": "\n        ";
+            out += __next_state(0, c) < _num? "1,": "0,";
+        }
+        out += "\n    };\n";
+    }
+
+    /*
+     * 把惰性DFA完全展开成按等价类索引的表name和接受标记nameok, 0xff为死状态.
+     * 在副本上展开, 不影响搜索用的缓存; 超过255个状态或缓存被清空时返回false
+     */
+    bool __generate_table(std::string& out, const lazy_dfa_t* dfa, const char* name) const
+    {
+        char buf[96];
+        size_t width = (size_t)1 << _cshift;
+        unsigned char rep[256];
+        for (int c = 255; c >= 0; c--)
+        {
+            rep[_classes[c]] = (unsigned char)c;
+        }
+        lazy_dfa_t* d = lazy_dfa_t::clone(dfa);
+        std::string rows;
+        bool ok = true;
+        for (size_t s = 0; ok && s < d->_states.size(); s++)
+        {
+            for (size_t k = 0; ok && k < width; k++)
+            {
+                rows += k % 32? "": "\n        ";
+                size_t t = d->next(s, rep[k]);
+                ok = d->_flushes == 0 && d->_states.size() < 0xff;
+                snprintf(buf, sizeof(buf), "%u,", t == lazy_dfa_t::DEAD? 0xffu: (unsigned)t);
+                rows += buf;
+            }
+        }
+        if (ok)
+        {
+            snprintf(buf, sizeof(buf), "    static const unsigned char %s[%u] = {", name, (unsigned)(d->_states.size() * width));
+            out += buf;
+            out += rows;
+            snprintf(buf, sizeof(buf), "\n    };\n    static const unsigned char %sok[%u] = {", name, (unsigned)d->_states.size());
+            out += buf;
+            for (size_t s = 0; s < d->_states.size(); s++)
+            {
+                out += s % 32? "": "\n        ";
+                out += d->_accept[s]? "1,": "0,";
+            }
+            out += "\n    };\n";
+        }
+        lazy_dfa_t::release(d);
+        return ok;
+    }
+
+    // 下一个状态, 死状态和bad char返回_num以上的值
+    size_t __next_state(size_t s, int c) const
+    {
+        size_t t = _trans? _trans[(s << _cshift) + _classes[c]]: _wtrans[(s << _cshift) + _classes[c]];
+        return t < (_trans? 0xfeu: 0xfffeu)? t: _num;
+    }
+
+    void __generate_state(std::string& out, size_t s, bool label, bool* target) const
+    {
+        char buf[96];
+        bool any = false;
+        for (size_t t = 0; t < _num; t++)
+        {
+            target[t] = false;
+        }
+        for (int c = 0; c < 256; c++)
+        {
+            size_t t = __next_state(s, c);
+            if (t < _num)
+            {
+                any = target[t] = true;
+            }
+        }
+        if (label)
+        {
+            snprintf(buf, sizeof(buf), "S%u:\n", (unsigned)s);
+            out += buf;
+            if (_accept[s])
+            {
+                out += matchend? "    if (p == e) return p;\n": matchmin? "    return p;\n": "    r = p;\n";
+            }
+        }
+        if (!any)
+        {
+            out += "    return r;\n";
+            return;
+        }
+        for (size_t t = 0; t < _num; t++)
+        {
+            if (target[t] && __covers_all(s, t))
+            {
+                snprintf(buf, sizeof(buf), "    if (p == e) return r;\n    p++;\n    goto S%u;\n", (unsigned)t);
+                out += buf;
+                return;
+            }
+        }
+        out += "    if (p == e) return r;\n    c = *p++;\n";
+        size_t n = 0;
+        for (size_t t = 0; t < _num; t++)
+        {
+            std::string cond;
+            n += target[t]? __range_cond(cond, s, t): 0;
+        }
+        if (n > GEN_RANGES)
+        {
+            // 区间太多时按等价类跳转, 由编译器生成跳转表
+            out += "    switch (cls[c])\n    {\n";
+            for (size_t t = 0; t < _num; t++)
+            {
+                if (!target[t])
+                {
+                    continue;
+                }
+                bool seen[256] = {false};
+                for (int c = 0; c < 256; c++)
+                {
+                    if (!seen[_classes[c]] && __next_state(s, c) == t)
+                    {
+                        seen[_classes[c]] = true;
+                        snprintf(buf, sizeof(buf), "    case %u:\n", _classes[c]);
+                        out += buf;
+                    }
+                }
+                snprintf(buf, sizeof(buf), "        goto S%u;\n", (unsigned)t);
+                out += buf;
+            }
+            out += "    default:\n        return r;\n    }\n";
+            return;
+        }
+        for (size_t t = 0; t < _num; t++)
+        {
+            if (target[t])
+            {
+                std::string cond;
+                __range_cond(cond, s, t);
+                snprintf(buf, sizeof(buf), ") goto S%u;\n", (unsigned)t);
+                out += "    if (";
+                out += cond;
+                out += buf;
+            }
+        }
+        out += "    return r;\n";
+    }
+
+    // 生成s经输入字节到t的条件, 返回区间个数
+    size_t __range_cond(std::string& cond, size_t s, size_t t) const
+    {
+        char buf[32];
+        size_t n = 0;
+        for (int c = 0; c < 256; c++)
+        {
+            if (__next_state(s, c) != t)
+            {
+                continue;
+            }
+            int d = c;
+            while (d < 255 && __next_state(s, d + 1) == t)
+            {
+                d++;
+            }
+            if (c == d)
+            {
+                snprintf(buf, sizeof(buf), "c == 0x%02x", c);
+            }
+            else if (c == 0)
+            {
+                snprintf(buf, sizeof(buf), "c <= 0x%02x", d);
+            }
+            else if (d == 255)
+            {
+                snprintf(buf, sizeof(buf), "c >= 0x%02x", c);
+            }
+            else
+            {
+                snprintf(buf, sizeof(buf), "(c >= 0x%02x && c <= 0x%02x)", c, d);
+            }
+            cond += cond.empty()? "": " || ";
+            cond += buf;
+            c = d;
+            n++;
+        }
+        return n;
+    }
+
+    bool __covers_all(size_t s, size_t t) const
+    {
+        for (int c = 0; c < 256; c++)
+        {
+            if (__next_state(s, c) != t)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    long __get_flag() const
+    {
+        return (matchmin? MATCH_MIN: 0) | (_matchword? MATCH_WORD: 0) | (_ignorecase? MATCH_ICASE: 0) |
+            (_badcharopt? BAD_CHAR_OPT: 0) | (_lazydfa? LAZY_DFA: 0) | (_linearsearch? LINEAR_SEARCH: 0) |
+            (_bitparallel? BIT_PARALLEL: 0) | (_pikevm? PIKE_VM: 0);
+    }
+
+    // 检查载入的表中等价类和状态号都在范围内, 防止损坏的映像造成越界访问
+    bool __check_tables() const
+    {
+        size_t width = (size_t)1 << _cshift;
+        size_t transize = _num << _cshift;
+        for (int c = 0; c < 256; c++)
+        {
+            if (_classes[c] >= width)
+            {
+                return false;
+            }
+        }
+        for (size_t i = 0; i < _num; i++)
+        {
+            if (*(const unsigned char*)(_accept + i) > 1)
+            {
+                return false;
+            }
+        }
+        for (size_t i = 0; i < transize; i++)
+        {
+            size_t t = _trans? _trans[i]: _wtrans[i];
+            if (t >= _num && t < (_trans? 0xfeu: 0xfffeu))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // 前缀搜索从状态_prelen继续, 要求从状态0读入前缀的第i个字节后恰好到达状态i + 1
+    bool __check_prefix() const
+    {
+        for (size_t i = 0; i < _prelen; i++)
+        {
+            size_t k = (i << _cshift) + _classes[_prefix[i]];
+            if ((size_t)(_trans? _trans[k]: _wtrans[k]) != i + 1)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /*
+     * 设置LAZY_DFA模式下状态缓存的内存上限(字节), 需在compile之后调用,
+     * 超过上限时缓存被清空重建
+     */
+    void set_cache_limit(size_t bytes)
+    {
+        if (_lazy)
+        {
+            _lazy->_cap = bytes;
+        }
+        if (_fwd)
+        {
+            _fwd->_cap = _rev->_cap = _anc->_cap = _rrev->_cap = bytes;
+        }
+    }
+
+    /*
+     * 设置编译的预算: 子集构造最多生成states个状态, 转移表最多占bytes字节, 0表示不限制.
+     * 需在compile之前调用, 对以后的compile都有效. 超出预算时改用位并行模拟或NFA模拟,
+     * 搜索变慢但编译的时间与内存只与表达式的长度有关
+     */
+    void set_compile_budget(size_t states, size_t bytes = 0)
+    {
+        _maxstates = states;
+        _maxbytes = bytes;
+    }
+
+    size_t cache_flushes() const
+    {
+        return (_lazy? _lazy->_flushes: 0) +
+            (_fwd? _fwd->_flushes + _rev->_flushes + _anc->_flushes + _rrev->_flushes: 0);
+    }
+
+    void release()
+    {
+        program_t::release(_prog);
+        lazy_dfa_t::release(_lazy);
+        lazy_dfa_t::release(_fwd);
+        lazy_dfa_t::release(_rev);
+        lazy_dfa_t::release(_anc);
+        lazy_dfa_t::release(_rrev);
+        _pike_run_t<MEM>::release(_run);
+        _submatch_t<MEM>::release(_sub);
+        memset(this, 0, sizeof(re_t));
+    }
+
+    void __set_exp(const char* exp, size_t explen, long flag)
+    {
+        _exp = (char*)MEM::allocate(_explen = explen);
+        memcpy(_exp, exp, _explen);
+        __set_flag(flag);
+        __publish();
+    }
+
+    void __share(const re_t& another)
+    {
+        memcpy((void*)this, (const void*)&another, sizeof(re_t));
+        program_t::retain(_prog);
+        _lazy = lazy_dfa_t::clone(another._lazy);
+        _fwd = lazy_dfa_t::clone(another._fwd);
+        _rev = lazy_dfa_t::clone(another._rev);
+        _anc = lazy_dfa_t::clone(another._anc);
+        _rrev = lazy_dfa_t::clone(another._rrev);
+        _run = NULL;
+        _sub = NULL;
+    }
+
+    // 惰性DFA的位置自动机建好后只读, 由_prog释放, 复制的re_t共用
+    nfa_t* __new_nfa()
+    {
+        if (!_prog)
+        {
+            _prog = program_t::create();
+        }
+        nfa_t* nfa = nfa_t::create();
+        _prog->nfas.append(nfa);
+        return nfa;
+    }
+
+    // 编译前与其他对象脱离共享, 只带走表达式
+    void __unshare()
+    {
+        if (_prog && _prog->refs > 1)
+        {
+            char* exp = (char*)MEM::allocate(_explen);
+            memcpy(exp, _exp, _explen);
+            program_t::release(_prog);
+            _prog = NULL;
+            _exp = exp;
+            __publish();
+        }
+    }
+
+    // 把新生成的表交给_prog管理
+    void __publish()
+    {
+        if (!_prog)
+        {
+            _prog = program_t::create();
+        }
+        _prog->exp = _exp;
+        _prog->prefix = _prefix;
+        _prog->pretable = _pretable;
+        _prog->window = _window;
+        _prog->accept = _accept;
+        _prog->trans = _trans;
+        _prog->wtrans = _wtrans;
+        _prog->classes = _classes;
+        _prog->bits = _bits;
+        _prog->vm = _vm;
+    }
+
+    void __set_flag(long flag)
+    {
+        matchbegin = (flag & MATCH_BEGIN) != 0;
+        matchend = (flag & MATCH_END) != 0;
+        matchmin =  (flag & MATCH_MIN) != 0;
+        _matchword = (flag & MATCH_WORD) != 0;
+        _ignorecase = (flag & MATCH_ICASE) != 0; 
+        _badcharopt = (flag & BAD_CHAR_OPT) != 0;
+        _lazydfa = (flag & LAZY_DFA) != 0;
+        _linearsearch = (flag & LINEAR_SEARCH) != 0;
+        _bitparallel = (flag & BIT_PARALLEL) != 0;
+        _pikevm = (flag & PIKE_VM) != 0;
+    }
+
+    /*
+     * 子集构造, 生成的状态按发现顺序编号, 状态数记录在_num中;
+     * 状态数超过MAX_STATES时释放已生成的状态并返回ERR_TOO_MUCH_STATUS
+     */
+    error_t __generate_states(tree_t& tree, state_array_t& states, size_t limit = MAX_STATES)
+    {
+        state_t *start, *curstate;
+        state_stack_t stack;
+        state_array_t newstates;
+        delta_array_t newdelta;
+        state_index_t index;
+
+        start = state_t::create();
+        start->merge(tree.root->first);
+        start->rehash();
+        index.add(start);
+        stack.push(start);
+
+        _cmin = tree.root->charset.first();
+        _cmax = tree.root->charset.last();
+
+        while (!stack.empty())
+        {
+            states.append(stack.top());
+            stack.pop();
+            curstate = states.last();
+
+            /*
+             * 对curstate输入范围为[cmin,cmax]的字符，
+             * 将新生成的状态记录在newstates中，状态转移情况记录在newdelta中
+             */
+            __generate_new_state(curstate, tree, newstates, newdelta);
+            __merge_and_add(curstate, newstates, newdelta, index, stack);
+
+            if (__exp0(_num >= limit))
+            {
+                while (!stack.empty())
+                {
+                    state_t::release(stack.top());
+                    stack.pop();
+                }
+                for (state_iterator_t i = states.begin(); i != states.end(); i++)
+                {
+                    state_t::release(*i);
+                }
+                states.clear();
+                _num = 0;
+                return ERR_TOO_MUCH_STATUS;
+            }
+        }
+        _num++;
+        return NO_ERR;
+    }
+
+    void __generate_new_state(state_t* curstate, 
+                              tree_t& tree,
+                              state_array_t& newstates,
+                              delta_array_t& newdelta)
+    {
+        state_t* newstat;
+        state_iterator_t found;
+        int temp_statnum = 0;
+
+        newdelta.clear();
+        newstates.clear();
+
+        for (int c = _cmin; c <= _cmax; c++)
+        {
+            if ((newstat = __input_one_char(curstate, c, tree)))
+            {
+                newstat->rehash();
+                if ((found = __find_state(newstates.begin(), newstates.end(), newstat)))
+                {
+                    newdelta.append(_delta_t(c, (*found)->id));
+                    state_t::release(newstat);
+                }
+                else
+                {
+                    newstat->id = ++temp_statnum;
+                    newdelta.append(_delta_t(c, newstat->id));
+                    newstates.append(newstat);
+                }
+            }
+        }
+    }
+
+    void __merge_and_add(state_t* curstate,
+                         state_array_t& newstates,
+                         delta_array_t& newdelta,
+                         state_index_t& index,
+                         state_stack_t& stack)
+    {
+        state_t* found;
+        state_iterator_t i;
+        for (i = newstates.begin(); i != newstates.end(); i++)
+        {
+            if ((found = index.find(*i)))
+            {
+                for (_delta_t* p = newdelta.begin(); p != newdelta.end(); p++)
+                {
+                    if (p->id == (*i)->id)
+                    {
+                        curstate->add_delta(p->input, found->id);
+                    }
+                }
+                state_t::release(*i);
+            }
+            else
+            {
+                ++_num;
+                for (_delta_t* p = newdelta.begin(); p != newdelta.end(); p++)
+                {
+                    if (p->id == (*i)->id)
+                    {
+                        curstate->add_delta(p->input, _num);
+                    }
+                }
+                (*i)->id = _num;
+                index.add(*i);
+                stack.push(*i);
+            }
+        }
+    }
+
+    void __set_acceptions(state_array_t& states, const tree_t& tree)
+    {
+        state_iterator_t i = states.begin();
+        while (i != states.end())
+        {
+            for (const position_t* r = tree.receptions.begin(); r != tree.receptions.end(); r++)
+            {
+                if ((*i)->has(*r))
+                {
+                    (*i)->ok = true;
+                    break;
+                }
+            }
+            i++;
+        }
+    }
+
+    void __sort_states(state_array_t& states)
+    {
+        if (states.size() > 1)
+        {
+            typename state_array_t::value_t tmp;
+            state_iterator_t i = states.begin() + 1, j;
+            while (i != states.end())
+            {
+                tmp = *i;
+                for (j = i++; j > states.begin() && (*(j - 1))->id > tmp->id; j--)
+                {
+                    *j = *(j - 1);
+                }
+                *j = tmp;
+            }
+        }
+    }
+
+    /*
+     * 按各位置节点的字符集划分输入字节的等价类,
+     * 同一类中的字节在任何状态下的转移都相同
+     */
+    template <class AUTOMATON> void __generate_classes(AUTOMATON& automaton)
+    {
+        U16 remap[256][2];
+        size_t n = 1;
+        _classes = (unsigned char*)MEM::allocate(256);
+        memset(_classes, 0, 256);
+        for (position_t pos = 0; pos <= automaton.reception_pos(); pos++)
+        {
+            size_t m = 0;
+            memset(remap, 0xff, sizeof(remap));
+            for (int c = 0; c < 256; c++)
+            {
+                U16& r = remap[_classes[c]][automaton.node_at_pos(pos)->has(c) != 0];
+                if (r == 0xffff)
+                {
+                    r = (U16)m++;
+                }
+                _classes[c] = (unsigned char)r;
+            }
+            n = m;
+        }
+        _cshift = 0;
+        while (((size_t)1 << _cshift) < n)
+        {
+            _cshift++;
+        }
+    }
+
+    /*
+     * 不在根节点字符集中的字节不可能出现在任何匹配中,
+     * 将其所属的类在非0状态下标记为bad char
+     */
+    template <class T> void __mark_bad_classes(T* trans, T bad, tree_t& tree)
+    {
+        size_t width = (size_t)1 << _cshift;
+        bool isbad[256];
+        for (size_t k = 0; k < width; k++)
+        {
+            isbad[k] = false;
+        }
+        for (int c = 0; c < 256; c++)
+        {
+            if (!tree.root->charset.has(c))
+            {
+                isbad[_classes[c]] = true;
+            }
+        }
+        for (T *p = trans + width, *e = trans + (_num << _cshift); p < e; p += width)
+        {
+            for (size_t k = 0; k < width; k++)
+            {
+                if (isbad[k])
+                {
+                    p[k] = bad;
+                }
+            }
+        }
+    }
+
+    // 起始字节集合: 起始状态中各位置(OK除外)字符集的并
+    template <class AUTOMATON> void __generate_scanner(AUTOMATON& automaton)
+    {
+        bool set[256];
+        memset(set, 0, sizeof(set));
+        for (position_t pos = 0; pos < automaton.reception_pos(); pos++)
+        {
+            if (automaton.first_has(pos))
+            {
+                for (int c = 0; c < 256; c++)
+                {
+                    set[c] = set[c] || automaton.node_at_pos(pos)->has(c);
+                }
+            }
+        }
+        _scanner.build(set);
+    }
+
+    /*
+     * 位并行模式不生成转移表. 没有$时与__search_reverse一样三段式搜索,
+     * _bits[1]找最早的结束位置, _bits[2]向左找起点, _bits[0]求最长匹配; 有$时逐个起点用_bits[0]
+     */
+    void __generate_bits(tree_t& tree)
+    {
+        __generate_bit_tables(tree);
+        __generate_scanner(tree);
+        _start_fun = &re_t::__search_start_byte;
+        _match_fun = &re_t::__match_bits;
+        __set_engine(matchend? ENGINE_BITS: ENGINE_REVERSE);
+        __deal_with_literal(tree);
+    }
+
+    // 子集构造的状态数上限, 字节预算按转移表的大小折算, 需已生成等价类
+    size_t __state_budget(bool bits) const
+    {
+        size_t limit = bits? BIT_NFA_STATES: MAX_STATES;
+        size_t row = (size_t)1 << _cshift;
+        if (_maxstates && _maxstates < limit)
+        {
+            limit = _maxstates;
+        }
+        if (_maxbytes)
+        {
+            size_t n = _maxbytes / (row + 1) <= THR? _maxbytes / (row + 1): _maxbytes / (row * 2 + 1);
+            limit = n < limit? n: limit;
+        }
+        return limit;
+    }
+
+    bool __bits_fit(tree_t& tree) const
+    {
+        return !_matchword && !_badcharopt && size_t(tree.reception_pos()) + 2 <= _bit_nfa_t::MAX;
+    }
+
+    /*
+     * NFA模拟模式, 与位并行模式相同地使用三段式搜索;
+     * 有$时匹配只能结束于e, 改为从e向左一遍模拟右端锚定的反向自动机
+     */
+    void __generate_vm(tree_t& tree)
+    {
+        __generate_vm_tables(tree);
+        __generate_scanner(tree);
+        _start_fun = &re_t::__search_start_byte;
+        _match_fun = &re_t::__match_vm;
+        __set_engine(matchend? ENGINE_VM: ENGINE_REVERSE);
+        __deal_with_literal(tree);
+    }
+
+    void __generate_vm_tables(tree_t& tree)
+    {
+        _vm = (_pike_vm_t<MEM>*)MEM::allocate(3 * sizeof(_pike_vm_t<MEM>));
+        memset(_vm, 0, 3 * sizeof(_pike_vm_t<MEM>));
+        _nfa_t<TMP> anc, fwd, rev;
+        anc.build(tree);
+        _vm[0].build(anc, anc.positions.size());
+        if (!matchend)
+        {
+            fwd.build_unanchored(tree);
+            _vm[1].build(fwd, fwd.positions.size());
+            rev.build_reverse(tree, false);
+            _vm[2].build(rev, rev.positions.size());
+        }
+        else
+        {
+            rev.build_reverse(tree, true);
+            _vm[2].build(rev, rev.reception_pos() + 1);  // 去掉.*即右端锚定
+        }
+        _pike_run_t<MEM>::release(_run);
+        _run = NULL;
+    }
+
+    void __generate_bit_tables(tree_t& tree)
+    {
+        _bits = (_bit_nfa_t*)MEM::allocate(3 * sizeof(_bit_nfa_t));
+        _nfa_t<TMP> anc, fwd, rev;
+        anc.build(tree);
+        _bits[0].build(anc);
+        if (!matchend)
+        {
+            fwd.build_unanchored(tree);
+            _bits[1].build(fwd);
+            rev.build_reverse(tree, false);
+            _bits[2].build(rev);
+        }
+    }
+
+    void __generate_lazy_DFA(tree_t& tree)
+    {
+        nfa_t* nfa = __new_nfa();
+        nfa->build(tree);
+        __generate_classes(*nfa);
+        _lazy = lazy_dfa_t::create();
+        _lazy->init(nfa, _classes, _cshift, LAZY_CACHE_SIZE);
+        __generate_scanner(*nfa);
+        if (_matchword)
+        {
+            __generate_bound_table();
+            _match_fun = &re_t::__match_word_lazy;
+            __set_engine(ENGINE_WORD_LAZY);
+        }
+        else
+        {
+            _match_fun = &re_t::__match_lazy;
+            __set_engine(ENGINE_LAZY);
+        }
+    }
+
+    void __generate_DFA_bthr(state_array_t& states, tree_t& tree)
+    {
+        size_t transize = _num << _cshift;
+        _trans = (unsigned char*)MEM::allocate(transize);
+        memset(_trans, 0xff, transize);
+        _accept = (bool*)MEM::allocate(_num * sizeof(bool));
+        for (state_iterator_t i = states.begin(); i != states.end(); i++)
+        {
+            id_t id = (*i)->id;
+            _accept[id] = (*i)->ok;
+            for (_delta_t* j = (*i)->deltas.begin(); j != (*i)->deltas.end(); j++)
+            {
+                _trans[(id << _cshift) + _classes[j->input]] = (unsigned char)(j->id);
+            }
+        }
+        if (_badcharopt)
+        {
+            __mark_bad_classes<unsigned char>(_trans, 0xfe, tree);
+        }
+    }
+
+    void __generate_DFA_athr(state_array_t& states, tree_t& tree)
+    {
+        size_t transize = _num << _cshift;
+        _wtrans = (U16*)MEM::allocate(transize * sizeof(U16));
+        memset(_wtrans, 0xff, transize * sizeof(U16));
+        _accept = (bool*)MEM::allocate(_num * sizeof(bool));
+        for (state_iterator_t i = states.begin(); i != states.end(); i++)
+        {
+            id_t id = (*i)->id;
+            _accept[id] = (*i)->ok;
+            for (_delta_t* j = (*i)->deltas.begin(); j != (*i)->deltas.end(); j++)
+            {
+                _wtrans[(id << _cshift) + _classes[j->input]] = j->id;
+            }
+        }
+        if (_badcharopt)
+        {
+            __mark_bad_classes<U16>(_wtrans, 0xfffe, tree);
+        }
+    }
+
+    state_t* __input_one_char(state_t* stat, unsigned char c, tree_t& tree)
+    {
+        state_t* newstat = NULL;
+        int pos = stat->first();
+        int lastpos = stat->last();
+        while (pos <= lastpos)
+        {
+            if (stat->has(pos) && tree.node_at_pos(pos)->has(c))
+            {
+                if (__exp0(newstat == NULL))    // 只在第一个命中的位置创建
+                {
+                    newstat = state_t::create();
+                }
+                tree.follow_into(*newstat, pos);
+            }
+            pos++;
+        }
+        return newstat;
+    }
+
+    state_iterator_t __find_state(state_iterator_t i, state_iterator_t e, state_t* aim)
+    {
+        while (i != e && ((*i)->hash != aim->hash || !(*i)->equal(aim)))
+        {
+            i++;
+        }
+        return cond_ptr(i, i != e);
+    }
+
+    void __generate_bound_table()
+    {
+        _pretable = (unsigned char*)MEM::allocate(256);
+        memset(_pretable, 0, 256);
+        const unsigned char* p = (const unsigned char*)BOUND_CHARS;
+        while (*p)
+        {
+            _pretable[*p++] = 1;
+        }
+        _pretable[0] = 1;  // '\0' is also a word boundary
+    }
+
+    bool __deal_with_prefix(state_array_t& states)
+    {
+        if (__exp0(_matchword))
+        {
+            __generate_bound_table();
+            return false;
+        }
+
+        bool sample = false;
+        unsigned char buf[256];
+        id_t id = 0;
+        while (id < _num && _prelen < sizeof(buf))
+        {
+            state_t* s = states[id];
+            if (s->deltas.size() != 1 || s->deltas.first().id != id + 1 || s->ok)
+            {
+                break;
+            }
+            buf[_prelen++] = s->deltas.first().input;
+            id++;
+        }
+        if (id == _num)
+        {
+            sample = true;
+        }
+        __set_prefix(buf);
+        return sample;
+    }
+
+    /*
+     * 没有前缀时, 取每个匹配都必须包含的字面串放入_prefix, 先用__sp*找到它,
+     * 再向两边扩展到只含匹配字节的最大窗口, 在窗口内运行原来的搜索.
+     * 匹配不会跨越窗口, 窗口外也不会有匹配, 所以结果与直接搜索相同
+     */
+    void __deal_with_literal(tree_t& tree)
+    {
+        if (_prefix || _matchword || matchend)
+        {
+            return;
+        }
+        unsigned char buf[_literal_info_t::CAP];
+        size_t len = tree.required_literal(buf);
+        if (len < 2)
+        {
+            return;
+        }
+        _window = (unsigned char*)MEM::allocate(256);
+        memset(_window, 0, 256);
+        for (position_t pos = 0; pos < tree.reception_pos(); pos++)
+        {
+            for (int c = 0; c < 256; c++)
+            {
+                _window[c] |= tree.node_at_pos(pos)->has(c);
+            }
+        }
+        _prelen = len;
+        __set_prefix(buf);
+        _window_engine = _engine;
+        __set_engine(ENGINE_WITH_LITERAL);
+    }
+
+    /*
+     * 用三段式搜索代替逐个起点重试的循环:
+     * _fwd一遍扫描找到最早的匹配结束位置, _rev从该处向左找到匹配起点的下界,
+     * 再从下界开始正向确认最左最长的匹配. 两个辅助自动机都是惰性DFA, 与_classes共用等价类.
+     * 第一步处于起始状态时用_start_fun跳到下一个可能的起点, 有前缀时按前缀查找.
+     * 第三步的重复扫描累计过多时改用线性模式, 见__search_linear
+     */
+    void __deal_with_reverse(tree_t& tree)
+    {
+        if (_matchword || matchend || _badcharopt)
+        {
+            return;
+        }
+        _start_fun = _prefix? _search_prefix_fun: &re_t::__search_start_byte;
+        nfa_t* fwd = __new_nfa();
+        nfa_t* rev = __new_nfa();
+        nfa_t* anc = __new_nfa();
+        nfa_t* rrev = __new_nfa();
+        fwd->build_unanchored(tree);
+        rev->build_reverse(tree, false);
+        anc->build(tree);
+        rrev->build_reverse(tree, true);
+        _fwd = lazy_dfa_t::create();
+        _fwd->init(fwd, _classes, _cshift, LAZY_CACHE_SIZE);
+        _rev = lazy_dfa_t::create();
+        _rev->init(rev, _classes, _cshift, LAZY_CACHE_SIZE);
+        _anc = lazy_dfa_t::create();
+        _anc->init(anc, _classes, _cshift, LAZY_CACHE_SIZE);
+        _rrev = lazy_dfa_t::create();
+        _rrev->init(rrev, _classes, _cshift, LAZY_CACHE_SIZE);
+        __set_engine(ENGINE_REVERSE);
+    }
+
+    void __set_prefix(const unsigned char* buf)
+    {
+        if (_prelen)
+        {
+            _prefix = (unsigned char*)MEM::allocate(_prelen);
+            memcpy(_prefix, buf, _prelen);
+            switch (_prelen)
+            {
+                case 0: break;
+                case 1:  _search_prefix_fun = &re_t::__sp1;  break;
+                case 2:  _search_prefix_fun = &re_t::__sp2;  break;
+                case 3:  _search_prefix_fun = &re_t::__sp3;  break;
+                case 4:  _search_prefix_fun = &re_t::__sp4;  break;
+                case 5:  _search_prefix_fun = &re_t::__sp5;  break;
+                case 6:  _search_prefix_fun = &re_t::__sp6;  break;
+                case 7:  _search_prefix_fun = &re_t::__sp7;  break;
+                case 8:  _search_prefix_fun = &re_t::__sp8;  break;
+                case 9:  _search_prefix_fun = &re_t::__sp9;  break;
+                case 10: _search_prefix_fun = &re_t::__sp10; break;
+                case 11: _search_prefix_fun = &re_t::__sp11; break;
+                case 12: _search_prefix_fun = &re_t::__sp12; break;
+                case 13: _search_prefix_fun = &re_t::__sp13; break;
+                case 14: _search_prefix_fun = &re_t::__sp14; break;
+                case 15: _search_prefix_fun = &re_t::__sp15; break;
+                case 16: _search_prefix_fun = &re_t::__sp16; break;
+                default: _search_prefix_fun = &re_t::__spx;  break;
+            }
+            if (_prelen >= 4)
+            {
+                unsigned char *p, *e;
+                _pretable = (unsigned char*)MEM::allocate(256);
+                memset(_pretable, _prelen + 1, 256);
+                for (p = _prefix, e = _prefix + _prelen; p != e; p++)
+                {
+                    _pretable[*p] = _prelen - (p - _prefix); 
+                } 
+            }
+        }
+    }
+
+    void __debug_state(state_iterator_t i) const
+    {
+        printf("%u\t", (*i)->id);
+        for (int j = 0; j <= (*i)->last(); j++)
+        {
+            if ((*i)->has(j))
+            {
+                printf("%d ", j);
+            }
+        }
+        printf("\t\t");
+        for (_delta_t* j = (*i)->deltas.begin(); j != (*i)->deltas.end(); j++)
+        {
+            if (j->input >= 33 && j->input <= 126)
+            {
+                printf("(%c, %d) ", j->input, j->id);
+            }
+            else
+            {
+                printf("(\\x%x, %d) ", j->input, j->id);
+            }
+        }
+        if ((*i)->ok)
+        {
+            printf("OK");
+        }
+        printf("\n");
+    }
+
+    const unsigned char* __match_bthr(const unsigned char* p, const unsigned char* e)
+    {
+        size_t s = 0, a = 0;
+        const unsigned char* r = NULL;
+        while (p < e && !(a && matchmin))
+        {
+            if ((s = _trans[(s << _cshift) + _classes[*p++]]) >= 0xfe)
+            {
+                break;
+            }
+            if ((a = _accept[s] && (!matchend || (matchend && p == e))))
+            {
+                r = p;
+            }
+        }
+        return r;
+    }
+
+    const unsigned char* __match_word_bthr(const unsigned char* p, const unsigned char* e)
+    {
+        size_t s = 0, a = 0;
+        const unsigned char* r = NULL;
+        while (p < e && !(a && matchmin) && (s = _trans[(s << _cshift) + _classes[*p++]]) < 0xfe)
+        {
+            if (__exp1(!matchend))
+            {
+                a = _accept[s] && (p == e || _pretable[*p]);
+            }
+            else
+            {
+                a = _accept[s] && p == e;
+            }
+            if (__exp1(a))
+            {
+                r = p;
+            }
+        }
+        return r;
+    }
+
+    const unsigned char* __match_athr(const unsigned char* p, const unsigned char* e)
+    {
+        size_t s = 0, a = 0;
+        const unsigned char* r = NULL;
+        while (p < e && !(a && matchmin))
+        {
+            if ((s = _wtrans[(s << _cshift) + _classes[*p++]]) >= 0xfffe)
+            {
+                break;
+            }
+            if ((a = _accept[s] && (!matchend || (matchend && p == e))))
+            {
+                r = p;
+            }
+        }
+        return r;
+    }
+
+    const unsigned char* __match_word_athr(const unsigned char* p, const unsigned char* e)
+    {
+        size_t s = 0, a = 0;
+        const unsigned char* r = NULL;
+        while (p < e && !(a && matchmin) && (s = _wtrans[(s << _cshift) + _classes[*p++]]) < 0xfffe)
+        {
+            if (__exp1(!matchend))
+            {
+                a = _accept[s] && (p == e || _pretable[*p]);
+            }
+            else
+            {
+                a = _accept[s] && p == e;
+            }
+            if (__exp1(a))
+            {
+                r = p;
+            }
+        }
+        return r;
+    }
+
+    const unsigned char* __match_lazy(const unsigned char* p, const unsigned char* e)
+    {
+        size_t s = 0, a = 0;
+        const unsigned char* r = NULL;
+        while (p < e && !(a && matchmin))
+        {
+            if ((s = _lazy->next(s, *p++)) == lazy_dfa_t::DEAD)
+            {
+                break;
+            }
+            if ((a = _lazy->_accept[s] && (!matchend || (matchend && p == e))))
+            {
+                r = p;
+            }
+        }
+        return r;
+    }
+
+    const unsigned char* __match_word_lazy(const unsigned char* p, const unsigned char* e)
+    {
+        size_t s = 0, a = 0;
+        const unsigned char* r = NULL;
+        while (p < e && !(a && matchmin) && (s = _lazy->next(s, *p++)) != lazy_dfa_t::DEAD)
+        {
+            if (__exp1(!matchend))
+            {
+                a = _lazy->_accept[s] && (p == e || _pretable[*p]);
+            }
+            else
+            {
+                a = _lazy->_accept[s] && p == e;
+            }
+            if (__exp1(a))
+            {
+                r = p;
+            }
+        }
+        return r;
+    }
+
+    const unsigned char* __match_bits(const unsigned char* p, const unsigned char* e)
+    {
+        const _bit_nfa_t& b = _bits[0];
+        U64 s = b.first, a = 0;
+        const unsigned char* r = NULL;
+        while (p < e && !(a && matchmin))
+        {
+            if (!(s = b.next(s, *p++)))
+            {
+                break;
+            }
+            if ((a = (s & b.accept) && (!matchend || p == e)))
+            {
+                r = p;
+            }
+        }
+        return r;
+    }
+
+    _pike_run_t<MEM>& __run()
+    {
+        if (!_run)
+        {
+            size_t n = _vm[0].num;
+            for (int i = 1; i < 3; i++)
+            {
+                n = _vm[i].num > n? _vm[i].num: n;
+            }
+            _run = _pike_run_t<MEM>::create(n);
+        }
+        return *_run;
+    }
+
+    const unsigned char* __match_vm(const unsigned char* p, const unsigned char* e)
+    {
+        const _pike_vm_t<MEM>& v = _vm[0];
+        _pike_run_t<MEM>& run = __run();
+        const unsigned char* r = NULL;
+        bool a = false;
+        v.start(run);
+        while (p < e && !(a && matchmin))
+        {
+            if (!v.step(run, *p++))
+            {
+                break;
+            }
+            if ((a = v.accepted(run) && (!matchend || p == e)))
+            {
+                r = p;
+            }
+        }
+        return r;
+    }
+
+    const unsigned char* __match_sample(const unsigned char* P, const unsigned char* E)
+    {
+        if (ptrdiff_t(E - P) >= ptrdiff_t(_prelen))
+        {
+            const unsigned short* p = (const unsigned short*)(P);
+            const unsigned short* q = (const unsigned short*)(_prefix);
+            const unsigned short* r = (const unsigned short*)(_prefix + _prelen - (_prelen & 1));
+            while (q != r && *p == *q)
+            {
+                p++;
+                q++;
+            }
+            if (q != r || (_prelen & 1 && *(const unsigned char*)r != *(const unsigned char*)p))
+            {
+                return NULL;
+            }
+            return (const unsigned char*)p;
+        }
+        return NULL;
+    }
+
+    template <class SINK> int __search(const unsigned char* p, const unsigned char* e, SINK& results, long n)
+    {
+        if (__exp1(p < e))
+        {
+            if (__exp1(!matchbegin))
+            {
+                return __search_by(p, e, results, n);
+            }
+            else
+            {
+                const unsigned char* r = (this->*_match_fun)(p, e);
+                if (r)
+                {
+                    if (!results.put(p, r) || !--n)
+                    {
+                        return RESULTS_ENOUGH;
+                    }
+                }
+            }
+        }
+        return RESULTS_NOT_ENOUGH;
+    }
+
+    void __set_engine(engine_t k)
+    {
+        _engine = k;
+        switch (k)
+        {
+            case ENGINE_WITH_PREFIX_BTHR:
+                _search_fun = &re_t::template __search_with_prefix_bthr<results_t>;
+                break;
+            case ENGINE_WITHOUT_PREFIX_BTHR:
+                _search_fun = &re_t::template __search_without_prefix_bthr<results_t>;
+                break;
+            case ENGINE_WORD_BTHR:
+                _search_fun = &re_t::template __search_word_bthr<results_t>;
+                break;
+            case ENGINE_WITH_PREFIX_ATHR:
+                _search_fun = &re_t::template __search_with_prefix_athr<results_t>;
+                break;
+            case ENGINE_WITHOUT_PREFIX_ATHR:
+                _search_fun = &re_t::template __search_without_prefix_athr<results_t>;
+                break;
+            case ENGINE_WORD_ATHR:
+                _search_fun = &re_t::template __search_word_athr<results_t>;
+                break;
+            case ENGINE_LAZY:
+                _search_fun = &re_t::template __search_lazy<results_t>;
+                break;
+            case ENGINE_WORD_LAZY:
+                _search_fun = &re_t::template __search_word_lazy<results_t>;
+                break;
+            case ENGINE_REVERSE:
+                _search_fun = &re_t::template __search_reverse<results_t>;
+                break;
+            case ENGINE_BITS:
+                _search_fun = &re_t::template __search_bits<results_t>;
+                break;
+            case ENGINE_VM:
+                _search_fun = &re_t::template __search_vm<results_t>;
+                break;
+            case ENGINE_SAMPLE:
+                _search_fun = &re_t::template __search_sample<results_t>;
+                break;
+            case ENGINE_WITH_LITERAL:
+                _search_fun = &re_t::template __search_with_literal<results_t>;
+                break;
+        }
+    }
+
+    int __search_by(const unsigned char* p, const unsigned char* e, results_t& results, long n)
+    {
+        return (this->*_search_fun)(p, e, results, n);
+    }
+
+    // 其他SINK不能经由函数指针调用, 按_engine分派到对应的实例
+    template <class SINK> int __search_by(const unsigned char* p, const unsigned char* e, SINK& results, long n)
+    {
+        if (_engine == ENGINE_WITH_LITERAL)
+        {
+            return __search_with_literal(p, e, results, n);
+        }
+        return __search_window_by(_engine, p, e, results, n);
+    }
+
+    // 不含__search_with_literal, 它的窗口内搜索经由这里, 以免SINK类型无限嵌套
+    template <class SINK> int __search_window_by(engine_t k, const unsigned char* p, const unsigned char* e, SINK& results, long n)
+    {
+        switch (k)
+        {
+            case ENGINE_WITH_PREFIX_BTHR:
+                return __search_with_prefix_bthr(p, e, results, n);
+            case ENGINE_WITHOUT_PREFIX_BTHR:
+                return __search_without_prefix_bthr(p, e, results, n);
+            case ENGINE_WORD_BTHR:
+                return __search_word_bthr(p, e, results, n);
+            case ENGINE_WITH_PREFIX_ATHR:
+                return __search_with_prefix_athr(p, e, results, n);
+            case ENGINE_WITHOUT_PREFIX_ATHR:
+                return __search_without_prefix_athr(p, e, results, n);
+            case ENGINE_WORD_ATHR:
+                return __search_word_athr(p, e, results, n);
+            case ENGINE_LAZY:
+                return __search_lazy(p, e, results, n);
+            case ENGINE_WORD_LAZY:
+                return __search_word_lazy(p, e, results, n);
+            case ENGINE_REVERSE:
+                return __search_reverse(p, e, results, n);
+            case ENGINE_BITS:
+                return __search_bits(p, e, results, n);
+            case ENGINE_VM:
+                return __search_vm(p, e, results, n);
+            case ENGINE_SAMPLE:
+                return __search_sample(p, e, results, n);
+            case ENGINE_WITH_LITERAL:
+                break;
+        }
+        assert(!"__deal_with_literal never nests ENGINE_WITH_LITERAL");
+        return RESULTS_NOT_ENOUGH;
+    }
+
+    template <class SINK> int __search_with_prefix_bthr(const unsigned char* p, const unsigned char* e, SINK& results, long n)
+    {
+        size_t s, a;
+        const unsigned char *x, *y;
+        while ((p = (this->*_search_prefix_fun)(p, e)))
+        {
+            s = _prelen;
+            x = p + _prelen;
+            a = _accept[s] && (!matchend || x == e);
+            y = cond_ptr(x, a);
+            while (x != e && !(a && matchmin))
+            {
+                if ((s = _trans[(s << _cshift) + _classes[*x++]]) >= 0xfe)
+                {
+                    break;
+                }
+                if ((a = _accept[s] && (!matchend || (matchend && x == e))))
+                {
+                    y = x;
+                }
+            }
+            if (y)
+            {
+                if (!results.put(p, y) || !--n)
+                {
+                    return RESULTS_ENOUGH;
+                }
+                p = y;
+            }
+            else
+            {
+                p++; 
+            }
+            if (s == 0xfe)
+            {
+                p = x;
+            }
+        }
+        return RESULTS_NOT_ENOUGH;
+    }
+
+    template <class SINK> int __search_without_prefix_bthr(const unsigned char* p, const unsigned char* e, SINK& results, long n)
+    {
+        size_t s, a;
+        const unsigned char *x, *y;
+        while (p != e)
+        {
+            if ((p = _scanner.scan(p, e)) != e)  // 0xfe 不必出现在0状态中
+            {
+                s = _trans[_classes[*p]];
+                x = p + 1;
+                a = _accept[s] && (!matchend || x == e);
+                y = cond_ptr(x, a);
+                while (x != e && !(a && matchmin))
+                {
+                    if ((s = _trans[(s << _cshift) + _classes[*x++]]) >= 0xfe)  // 将此逻辑分析放到while的逻辑表达式中
+                    {
+                        break;
+                    }
+                    if ((a = _accept[s] && (!matchend || (matchend && x == e))))
+                    {
+                        y = x;
+                    }
+                }
+                if (y)
+                {
+                    if (!results.put(p, y) || !--n)
+                    {
+                        return RESULTS_ENOUGH;
+                    }
+                    p = y;
+                }
+                else
+                {
+                    p++;
+                }
+                if (s == 0xfe)
+                {
+                    p = x;
+                }
+            }
+        }
+        return RESULTS_NOT_ENOUGH;
+    }
+
+    template <class SINK> int __search_word_bthr(const unsigned char* p, const unsigned char* e, SINK& results, long n)
+    {
+        const unsigned char *q;
+        while (p != e)
+        {
+            while (p != e && _pretable[*p])
+            {
+                p++;
+            }
+            if ((q = __match_word_bthr(p, e)))
+            {
+                if (!results.put(p, q) || !--n)
+                {
+                    return RESULTS_ENOUGH;
+                }
+                p = q;   // q>p, 且q处是分隔符或e, 下一轮先跳过分隔符
+            }
+            else while (p != e && !_pretable[*p])
+            {
+                p++;
+            }
+        }
+        return RESULTS_NOT_ENOUGH;
+    }
+
+    template <class SINK> int __search_with_prefix_athr(const unsigned char* p, const unsigned char* e, SINK& results, long n)
+    {
+        size_t s, a;
+        const unsigned char *x, *y;
+        while ((p = (this->*_search_prefix_fun)(p, e)))
+        {
+            s = _prelen;
+            x = p + _prelen;
+            a = _accept[s] && (!matchend || x == e);
+            y = cond_ptr(x, a);
+            while (x != e && !(a && matchmin))
+            {
+                if ((s = _wtrans[(s << _cshift) + _classes[*x++]]) >= 0xfffe)
+                {
+                    break;
+                }
+                if ((a = _accept[s] && (!matchend || (matchend && x == e))))
+                {
+                    y = x;
+                }
+            }
+            if (y)
+            {
+                if (!results.put(p, y) || !--n)
+                {
+                    return RESULTS_ENOUGH;
+                }
+                p = y;
+            }
+            else
+            {
+                p++;
+            }
+            if (s == 0xfffe)
+            {
+                p = x;
+            }
+        }
+        return RESULTS_NOT_ENOUGH;
+    }
+
+    template <class SINK> int __search_without_prefix_athr(const unsigned char* p, const unsigned char* e, SINK& results, long n)
+    {
+        size_t s, a;
+        const unsigned char *x, *y;
+        while (p != e)
+        {
+            if ((p = _scanner.scan(p, e)) != e)
+            {
+                s = _wtrans[_classes[*p]];
+                x = p + 1;
+                a = _accept[s] && (!matchend || x == e);
+                y = cond_ptr(x, a);
+                while (x != e && !(a && matchmin))
+                {
+                    if ((s = _wtrans[(s << _cshift) + _classes[*x++]]) >= 0xfffe)
+                    {
+                        break;
+                    }
+                    if ((a = _accept[s] && (!matchend || (matchend && x == e))))
+                    {
+                        y = x;
+                    }
+                }
+                if (y)
+                {
+                    if (!results.put(p, y) || !--n)
+                    {
+                        return RESULTS_ENOUGH;
+                    }
+                    p = y;
+                }
+                else
+                {
+                    p++;
+                }
+                if (s == 0xfffe)
+                {
+                    p = x;
+                }
+            }
+        }
+        return RESULTS_NOT_ENOUGH;
+    }
+
+    template <class SINK> int __search_word_athr(const unsigned char* p, const unsigned char* e, SINK& results, long n)
+    {
+        const unsigned char *q;
+        while (p != e)
+        {
+            while (p != e && _pretable[*p])
+            {
+                p++;
+            }
+            if ((q = __match_word_athr(p, e)))
+            {
+                if (!results.put(p, q) || !--n)
+                {
+                    return RESULTS_ENOUGH;
+                }
+                p = q;
+            }
+            else while (p != e && !_pretable[*p])
+            {
+                p++;
+            }
+        }
+        return RESULTS_NOT_ENOUGH;
+    }
+
+    template <class SINK> int __search_lazy(const unsigned char* p, const unsigned char* e, SINK& results, long n)
+    {
+        size_t s, a;
+        const unsigned char *x, *y;
+        while (p != e)
+        {
+            if ((p = _scanner.scan(p, e)) != e)
+            {
+                s = _lazy->next(0, *p);
+                x = p + 1;
+                a = _lazy->_accept[s] && (!matchend || x == e);
+                y = cond_ptr(x, a);
+                while (x != e && !(a && matchmin))
+                {
+                    if ((s = _lazy->next(s, *x++)) == lazy_dfa_t::DEAD)
+                    {
+                        break;
+                    }
+                    if ((a = _lazy->_accept[s] && (!matchend || (matchend && x == e))))
+                    {
+                        y = x;
+                    }
+                }
+                if (y)
+                {
+                    if (!results.put(p, y) || !--n)
+                    {
+                        return RESULTS_ENOUGH;
+                    }
+                    p = y;
+                }
+                else
+                {
+                    p++;
+                }
+            }
+        }
+        return RESULTS_NOT_ENOUGH;
+    }
+
+    template <class SINK> int __search_bits(const unsigned char* p, const unsigned char* e, SINK& results, long n)
+    {
+        const unsigned char* y;
+        while (p != e)
+        {
+            if ((p = _scanner.scan(p, e)) != e)
+            {
+                if ((y = __match_bits(p, e)))
+                {
+                    if (!results.put(p, y) || !--n)
+                    {
+                        return RESULTS_ENOUGH;
+                    }
+                    p = y;
+                }
+                else
+                {
+                    p++;
+                }
+            }
+        }
+        return RESULTS_NOT_ENOUGH;
+    }
+
+    // 有$时的NFA模拟: 从e向左扫描, 最左的接受处即起点, 每个字节只模拟一次
+    template <class SINK> int __search_vm(const unsigned char* p, const unsigned char* e, SINK& results, long n)
+    {
+        const _pike_vm_t<MEM>& v = _vm[2];
+        _pike_run_t<MEM>& run = __run();
+        const unsigned char *x = e, *q = NULL;
+        v.start(run);
+        while (x != p && v.step(run, *--x))
+        {
+            if (v.accepted(run))
+            {
+                q = x;
+            }
+        }
+        if (q && (!results.put(q, e) || !--n))
+        {
+            return RESULTS_ENOUGH;
+        }
+        return RESULTS_NOT_ENOUGH;
+    }
+
+    template <class SINK> int __search_word_lazy(const unsigned char* p, const unsigned char* e, SINK& results, long n)
+    {
+        const unsigned char *q;
+        while (p != e)
+        {
+            while (p != e && _pretable[*p])
+            {
+                p++;
+            }
+            if ((q = __match_word_lazy(p, e)))
+            {
+                if (!results.put(p, q) || !--n)
+                {
+                    return RESULTS_ENOUGH;
+                }
+                p = q;
+            }
+            else while (p != e && !_pretable[*p])
+            {
+                p++;
+            }
+        }
+        return RESULTS_NOT_ENOUGH;
+    }
+
+    const unsigned char* __search_start_byte(const unsigned char* p, const unsigned char* e)
+    {
+        p = _scanner.scan(p, e);
+        return p != e? p: NULL;
+    }
+
+    /*
+     * [p, t)之后再有输入时仍可能改变结果的最左起点, 即最左的q使[q, t)是某个匹配的前缀, 没有时返回t.
+     * 无法判断时(单词模式, 表达式以$结尾, BAD_CHAR_OPT)返回p
+     */
+    const unsigned char* __pending_start(const unsigned char* p, const unsigned char* t)
+    {
+        if (_rev || ((_bitparallel || _pikevm) && !matchend))
+        {
+            return __leftmost_start(p, t);
+        }
+        if (_engine == ENGINE_SAMPLE)
+        {
+            const unsigned char* q = size_t(t - p) < _prelen? p: t - _prelen + 1;
+            while (q != t && memcmp(q, _prefix, t - q))
+            {
+                q++;
+            }
+            return q;
+        }
+        return p;
+    }
+
+    /*
+     * 最早的匹配结束位置, 没有匹配时返回NULL.
+     * 一次扫描中_fwd的缓存清空两次以上说明子集爆炸(如x.{25}c), 从头改用备用的_bits或_vm
+     */
+    const unsigned char* __first_end(const unsigned char* p, const unsigned char* e)
+    {
+        if (_bitparallel)
+        {
+            return __first_end_bits(p, e);
+        }
+        if (_pikevm)
+        {
+            return __first_end_vm(p, e);
+        }
+        size_t s = 0, flushes = _fwd->_flushes;
+        const unsigned char* b = p;
+        while (p != e)
+        {
+            if (s == 0 && !(p = (this->*_start_fun)(p, e)))
+            {
+                break;
+            }
+            s = _fwd->next(s, *p++);
+            if (_fwd->_accept[s])
+            {
+                return p;
+            }
+            if (__exp0(_fwd->_flushes > flushes + 1) && __use_standby())
+            {
+                return __first_end(b, e);
+            }
+        }
+        return NULL;
+    }
+
+    // 改用DFA模式下备用的_bits或_vm, 没有备用时返回false
+    bool __use_standby()
+    {
+        if (_bits)
+        {
+            _bitparallel = true;
+        }
+        else if (_vm)
+        {
+            _pikevm = true;
+        }
+        return _bitparallel || _pikevm;
+    }
+
+    // 从x向左扫描, 返回最靠左的q使[q, x)是某个匹配的前缀
+    const unsigned char* __leftmost_start(const unsigned char* p, const unsigned char* x)
+    {
+        if (_bitparallel)
+        {
+            return __leftmost_start_bits(p, x);
+        }
+        if (_pikevm)
+        {
+            return __leftmost_start_vm(p, x);
+        }
+        size_t s = 0;
+        const unsigned char* r = x;
+        while (x != p && (s = _rev->next(s, *--x)) != lazy_dfa_t::DEAD)
+        {
+            if (_rev->_accept[s])
+            {
+                r = x;
+            }
+        }
+        return r;
+    }
+
+    // 从p开始的最长(matchmin时最短)匹配, stop为扫描停止的位置
+    const unsigned char* __longest(const unsigned char* p, const unsigned char* e, const unsigned char*& stop)
+    {
+        if (_bitparallel)
+        {
+            return __longest_bits(p, e, stop);
+        }
+        if (_pikevm)
+        {
+            return __longest_vm(p, e, stop);
+        }
+        size_t s = 0;
+        const unsigned char* r = NULL;
+        while (p != e && (s = _anc->next(s, *p++)) != lazy_dfa_t::DEAD)
+        {
+            if (_anc->_accept[s])
+            {
+                r = p;
+                if (matchmin)
+                {
+                    break;
+                }
+            }
+        }
+        stop = p;
+        return r;
+    }
+
+    // 以下三个与上面对应, 用于位并行模式, 状态回到first即处于起始状态
+    const unsigned char* __first_end_bits(const unsigned char* p, const unsigned char* e)
+    {
+        const _bit_nfa_t& b = _bits[1];
+        U64 s = b.first;
+        while (p != e)
+        {
+            if (s == b.first && !(p = (this->*_start_fun)(p, e)))
+            {
+                break;
+            }
+            s = b.next(s, *p++);
+            if (s & b.accept)
+            {
+                return p;
+            }
+        }
+        return NULL;
+    }
+
+    const unsigned char* __leftmost_start_bits(const unsigned char* p, const unsigned char* x)
+    {
+        const _bit_nfa_t& b = _bits[2];
+        U64 s = b.first;
+        const unsigned char* r = x;
+        while (x != p && (s = b.next(s, *--x)))
+        {
+            if (s & b.accept)
+            {
+                r = x;
+            }
+        }
+        return r;
+    }
+
+    const unsigned char* __longest_bits(const unsigned char* p, const unsigned char* e, const unsigned char*& stop)
+    {
+        const _bit_nfa_t& b = _bits[0];
+        U64 s = b.first;
+        const unsigned char* r = NULL;
+        while (p != e && (s = b.next(s, *p++)))
+        {
+            if (s & b.accept)
+            {
+                r = p;
+                if (matchmin)
+                {
+                    break;
+                }
+            }
+        }
+        stop = p;
+        return r;
+    }
+
+    // NFA模拟模式下的三个, 同上
+    const unsigned char* __first_end_vm(const unsigned char* p, const unsigned char* e)
+    {
+        const _pike_vm_t<MEM>& v = _vm[1];
+        _pike_run_t<MEM>& run = __run();
+        v.start(run);
+        while (p != e)
+        {
+            if (v.initial(run) && !(p = (this->*_start_fun)(p, e)))
+            {
+                break;
+            }
+            v.step(run, *p++);
+            if (v.accepted(run))
+            {
+                return p;
+            }
+        }
+        return NULL;
+    }
+
+    const unsigned char* __leftmost_start_vm(const unsigned char* p, const unsigned char* x)
+    {
+        const _pike_vm_t<MEM>& v = _vm[2];
+        _pike_run_t<MEM>& run = __run();
+        const unsigned char* r = x;
+        v.start(run);
+        while (x != p && v.step(run, *--x))
+        {
+            if (v.accepted(run))
+            {
+                r = x;
+            }
+        }
+        return r;
+    }
+
+    const unsigned char* __longest_vm(const unsigned char* p, const unsigned char* e, const unsigned char*& stop)
+    {
+        const _pike_vm_t<MEM>& v = _vm[0];
+        _pike_run_t<MEM>& run = __run();
+        const unsigned char* r = NULL;
+        v.start(run);
+        while (p != e && v.step(run, *p++))
+        {
+            if (v.accepted(run))
+            {
+                r = p;
+                if (matchmin)
+                {
+                    break;
+                }
+            }
+        }
+        stop = p;
+        return r;
+    }
+
+    template <class SINK> int __search_reverse(const unsigned char* p, const unsigned char* e, SINK& results, long n)
+    {
+        const unsigned char *x, *y, *z;
+        const unsigned char* b = p;
+        size_t waste = 0;
+        bool linear = _rrev != NULL;  // 位并行模式没有线性模式
+        size_t flushes = _fwd? _fwd->_flushes: 0;
+        int ret;
+        if (_linearsearch && linear)
+        {
+            if ((ret = __search_linear(p, e, results, n)) != RESULTS_FAILED)
+            {
+                return ret;
+            }
+            linear = false;
+        }
+        while (p != e && (x = __first_end(p, e)))
+        {
+            if (__exp0(_fwd && !_bitparallel && !_pikevm && _fwd->_flushes > flushes + 1))
+            {
+                __use_standby();  // 同__first_end, 匹配很密时每次扫描都短, 按整个搜索累计
+            }
+            p = __leftmost_start(p, x);
+            for (;;)
+            {
+                y = __longest(p, e, z);
+                waste += z - (y? y: p);
+                if (y || ++p >= x)
+                {
+                    break;
+                }
+                p = _scanner.scan(p, x);
+            }
+            if (y)  // 结束于x的匹配保证了y不为空
+            {
+                if (!results.put(p, y) || !--n)
+                {
+                    return RESULTS_ENOUGH;
+                }
+                p = y;
+            }
+            // 匹配结尾之后的扫描在下一轮还会重复, 累计超过已推进长度的4倍时改用线性模式
+            if (__exp0(linear && waste > size_t(p - b) * 4 + 4096))
+            {
+                if ((ret = __search_linear(p, e, results, n)) != RESULTS_FAILED)
+                {
+                    return ret;
+                }
+                linear = false;
+            }
+        }
+        return RESULTS_NOT_ENOUGH;
+    }
+
+    // F与B中有接受c的公共位置, 即匹配可以读入c继续延伸到后面的某个结尾
+    __must_inline(bool) __extends(const typename lazy_dfa_t::state_t* F, const typename lazy_dfa_t::state_t* B, unsigned char c)
+    {
+        size_t cap = F->_cap < B->_cap? F->_cap: B->_cap;
+        for (size_t i = 0; i < cap; i++)
+        {
+            word_t w = F->_dat[i] & B->_dat[i];
+            for (size_t j = 0; w; j++, w <<= 1)
+            {
+                if ((w & A) && _anc->_nfa->node_at_pos((i << X) + j)->has(c))
+                {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    /*
+     * 线性模式: _rrev从e向左扫描一遍, 记下每处的状态B, B的接受状态即匹配起点;
+     * 再从各起点用_anc正向扫描, 只在当前状态与下一处的B有可读入当前字节的公共位置时继续,
+     * 因此每个字节正反各只扫描一次. 需要(e - p) * 2字节的额外内存,
+     * 反向扫描中_rrev的缓存被清空时状态编号失效, 返回RESULTS_FAILED
+     */
+    template <class SINK> int __search_linear(const unsigned char* p, const unsigned char* e, SINK& results, long n)
+    {
+        size_t len = e - p, flushes = _rrev->_flushes;
+        size_t i, k, s = 0;
+        const unsigned char* y;
+        U16* back = (U16*)MEM::allocate((len + 1) * sizeof(U16));
+        back[len] = 0;
+        for (i = len; i > 0; i--)
+        {
+            back[i - 1] = (U16)(s = _rrev->next(s, p[i - 1]));
+        }
+        if (__exp0(_rrev->_flushes != flushes))
+        {
+            MEM::deallocate(back);
+            return RESULTS_FAILED;
+        }
+        for (i = 0; i < len; i = y - p)
+        {
+            while (i < len && !_rrev->_accept[back[i]])
+            {
+                i++;
+            }
+            if (i == len)
+            {
+                break;
+            }
+            y = NULL;
+            for (s = 0, k = i; k < len && __extends(_anc->_states[s], _rrev->_states[back[k + 1]], p[k]); )
+            {
+                s = _anc->next(s, p[k++]);
+                if (_anc->_accept[s])
+                {
+                    y = p + k;
+                    if (matchmin)
+                    {
+                        break;
+                    }
+                }
+            }
+            if (!results.put(p + i, y) || !--n)  // 起点处B的接受保证了y不为空
+            {
+                MEM::deallocate(back);
+                return RESULTS_ENOUGH;
+            }
+        }
+        MEM::deallocate(back);
+        return RESULTS_NOT_ENOUGH;
+    }
+
+    template <class SINK> int __search_with_literal(const unsigned char* p, const unsigned char* e, SINK& results, long n)
+    {
+        const unsigned char *h, *a, *b;
+        _counted_sink_t<SINK> counted(results);
+        while ((h = (this->*_search_prefix_fun)(p, e)))
+        {
+            a = h;
+            b = h + _prelen;
+            while (a != p && _window[a[-1]])
+            {
+                a--;
+            }
+            while (b != e && _window[*b])
+            {
+                b++;
+            }
+            counted.count = 0;
+            if (__search_window_by(_window_engine, a, b, counted, n) == RESULTS_ENOUGH)
+            {
+                return RESULTS_ENOUGH;
+            }
+            n -= counted.count;
+            p = b;
+        }
+        return RESULTS_NOT_ENOUGH;
+    }
+
+    template <class SINK> int __search_sample(const unsigned char* p, const unsigned char* e, SINK& results, long n)
+    {
+        const unsigned char* q;
+        while ((p = (this->*_search_prefix_fun)(p, e)))
+        {
+            q = p + _prelen;
+            if (!results.put(p, q) || !--n)
+            {
+                return RESULTS_ENOUGH;
+            }
+            p = q;
+        }
+        return RESULTS_NOT_ENOUGH;
+    }
+
+    const unsigned char* __sp1(const unsigned char* P, const unsigned char* E)
     {
         return __memchr(P, *_prefix, E - P);
     }
 
-    const unsigned char* __sp2(const unsigned char* P, const unsigned char* E)
+    const unsigned char* __sp2(const unsigned char* P, const unsigned char* E)
+    {
+        E--;
+        const unsigned char* p = P;
+        ptrdiff_t len = E - p;
+        while (len > 0 && (p = __memchr(p, *_prefix, len)))
+        {
+            if (*(const unsigned short*)p == *(const unsigned short*)_prefix) return p;
+            len = E - ++p;
+        }
+        return NULL;
+    }
+
+    const unsigned char* __sp3(const unsigned char* P, const unsigned char* E)
+    {
+        E -= 2;
+        const unsigned char* p = P;
+        ptrdiff_t len = E - p;
+        unsigned short v = *(unsigned short*)(_prefix + 1);
+        while (len > 0 && (p = __memchr(p, *_prefix, len)))
+        {
+            if (*(const unsigned short*)(p + 1) == v) return p;
+            len = E - ++p;
+        }
+        return NULL;
+    }
+
+    #define __SUNDAY_SEARCH(fun_name, __mem_neq__) \
+    const unsigned char* fun_name (const unsigned char* P, const unsigned char* E)\
+    {\
+        const unsigned char *p = P, *e = P + _prelen;\
+        while (__exp1(e < E))\
+        {\
+            if (__exp1(__mem_neq__))\
+            {\
+                p += _pretable[*e]; e += _pretable[*e]; continue;\
+            }\
+            return p;\
+        }\
+        if (__exp0(e == E && !(__mem_neq__))) return p;\
+        return NULL;\
+    }
+    __SUNDAY_SEARCH (__sp4,  *(U32*)p != *(U32*)_prefix)
+    __SUNDAY_SEARCH (__sp5,  *(U32*)p != *(U32*)_prefix || *(p + 4) != *(_prefix + 4))
+    __SUNDAY_SEARCH (__sp6,  *(U32*)p != *(U32*)_prefix || *(U16*)(p + 4) != *(U16*)(_prefix + 4))
+    __SUNDAY_SEARCH (__sp7,  *(U32*)p != *(U32*)_prefix || *(U16*)(p + 4) != *(U16*)(_prefix + 4) || *(p + 6) != *(_prefix + 6))
+    __SUNDAY_SEARCH (__sp8,  *(U64*)p != *(U64*)_prefix)
+    __SUNDAY_SEARCH (__sp9,  *(U64*)p != *(U64*)_prefix || *(p + 8) != *(_prefix + 8))
+    __SUNDAY_SEARCH (__sp10, *(U64*)p != *(U64*)_prefix || *(U16*)(p + 8) != *(U16*)(_prefix + 8))
+    __SUNDAY_SEARCH (__sp11, *(U64*)p != *(U64*)_prefix || *(U16*)(p + 8) != *(U16*)(_prefix + 8) || *(p + 10) != *(_prefix + 10))
+    __SUNDAY_SEARCH (__sp12, *(U64*)p != *(U64*)_prefix || *(U32*)(p + 8) != *(U32*)(_prefix + 8))
+    __SUNDAY_SEARCH (__sp13, *(U64*)p != *(U64*)_prefix || *(U32*)(p + 8) != *(U32*)(_prefix + 8) || *(p + 12) != *(_prefix + 12))
+    __SUNDAY_SEARCH (__sp14, *(U64*)p != *(U64*)_prefix || *(U32*)(p + 8) != *(U32*)(_prefix + 8) || *(U16*)(p + 12) != *(U16*)(_prefix + 12))
+    __SUNDAY_SEARCH (__sp15, *(U64*)p != *(U64*)_prefix || *(U32*)(p + 8) != *(U32*)(_prefix + 8) || *(U16*)(p + 12) != *(U16*)(_prefix + 12) || *(p + 14) != *(_prefix + 14))
+    __SUNDAY_SEARCH (__sp16, *(U64*)p != *(U64*)_prefix || *(U64*)(p + 8) != *(U64*)(_prefix + 8))
+    #undef __SUNDAY_SEARCH
+
+    __must_inline(bool) __spx_mem_neq(const unsigned char* p)
+    {
+        const unsigned char* q = _prefix + 16;
+        const unsigned char* r = _prefix + _prelen;
+        while (q != r && *q == *p)
+        {
+            p++;
+            q++;
+        }
+        return q != r;
+    }
+
+    const unsigned char* __spx(const unsigned char* P, const unsigned char* E)
+    {
+        #define __mem_neq__ *(U64*)p != *(U64*)_prefix || *(U64*)(p + 8) != *(U64*)(_prefix + 8) || __spx_mem_neq(p + 16)
+        const unsigned char *p = P, *e = P + _prelen;
+        while (e < E)
+        {
+            if (__exp1(__mem_neq__))
+            {
+                p += _pretable[*e]; e += _pretable[*e]; continue;
+            }
+            return p;
+        }
+        if (__exp0(e == E && !(__mem_neq__)))
+        {
+            return p;
+        }
+        return NULL;
+        #undef __mem_neq__
+    }
+};
+
+/*
+ * 流式搜索: 输入分多次由feed给出, 匹配可以跨越两次feed的边界, 结果以绝对偏移表示.
+ * 只保留从仍可能成为匹配起点的最左位置开始的数据(见re_t::__pending_start),
+ * 没有这样的位置时直接在调用者的缓冲区上搜索, 不复制数据.
+ * 保留的数据在新输入累计到与其等长时才重新搜索, 因此总的扫描量与输入长度成线性,
+ * 代价是跨边界的匹配可能推迟到后面的feed才给出. 全部输入结束后调用finish
+ */
+template <class MEM> struct _stream_t
+{
+    typedef re_t<MEM> re_type;
+    typedef _results_t<MEM> results_t;
+    typedef _offset_results_t<MEM> offset_results_t;
+
+    re_type* _re;
+    unsigned char* _buf;  // 保留的数据
+    size_t _len;
+    size_t _cap;
+    size_t _scanned;      // 上次搜索后保留的长度
+    size_t _offset;       // _buf[0]的绝对偏移
+    size_t _total;        // 已输入的总长度
+    results_t _tmp;
+
+    _stream_t(re_type& re): _re(&re), _buf(NULL), _len(0), _cap(0), _scanned(0), _offset(0), _total(0)
+    {}
+
+    ~_stream_t()
+    {
+        MEM::deallocate(_buf);
+        _buf = NULL;
+    }
+
+    void reset()
+    {
+        _len = _scanned = _offset = _total = 0;
+    }
+
+    size_t offset() const
+    {
+        return _total;
+    }
+
+    size_t feed(const unsigned char* p, const unsigned char* e, offset_results_t& results)
+    {
+        size_t s0 = results.size();
+        const unsigned char* q;
+        if (!_len)
+        {
+            q = __process(p, e, _total, false, results);
+            _offset = _total + (q - p);
+            __append(q, e);
+            _scanned = _len;
+        }
+        else
+        {
+            __append(p, e);
+            if (_len >= _scanned << 1)
+            {
+                __keep(__process(_buf, _buf + _len, _offset, false, results));
+            }
+        }
+        _total += e - p;
+        return results.size() - s0;
+    }
+
+    size_t feed(const char* p, const char* e, offset_results_t& results)
+    {
+        return feed((const unsigned char*)p, (const unsigned char*)e, results);
+    }
+
+    size_t finish(offset_results_t& results)
+    {
+        size_t s0 = results.size();
+        if (_len)
+        {
+            __keep(__process(_buf, _buf + _len, _offset, true, results));
+        }
+        _scanned = 0;
+        return results.size() - s0;
+    }
+
+    // 搜索[b, t), 输出之后的输入不会再改变的匹配, 返回需要保留的起点
+    const unsigned char* __process(const unsigned char* b, const unsigned char* t, size_t off, bool last, offset_results_t& results)
+    {
+        if (_re->matchbegin && off)
+        {
+            return t;
+        }
+        const unsigned char* cut = last? t: _re->__pending_start(b, t);
+        _tmp.clear();
+        _re->search(b, t, _tmp, SEARCH_ALL);
+        for (_result_t* i = _tmp.begin(); i != _tmp.end() && i->p < cut; i++)
+        {
+            results.append(_offset_result_t(off + (i->p - b), off + (i->e - b)));
+            if (i->e > cut)
+            {
+                cut = _re->__pending_start(i->e, t);
+            }
+        }
+        return cut;
+    }
+
+    void __keep(const unsigned char* q)
+    {
+        size_t n = _buf + _len - q;
+        memmove(_buf, q, n);
+        _offset += q - _buf;
+        _len = _scanned = n;
+    }
+
+    void __append(const unsigned char* p, const unsigned char* e)
+    {
+        size_t n = e - p;
+        if (!n)
+        {
+            return;  // 第一次为空时_buf还是NULL
+        }
+        if (_len + n > _cap)
+        {
+            _cap = (_len + n) << 1;
+            _buf = (unsigned char*)MEM::reallocate(_cap, _buf);
+        }
+        memcpy(_buf + _len, p, n);
+        _len += n;
+    }
+};
+
+struct _set_result_t: public _result_t
+{
+    size_t id;  // 匹配的表达式在compile时的序号
+
+    _set_result_t(const unsigned char* x, const unsigned char* y, size_t z): _result_t(x, y), id(z)
+    {}
+};
+
+template <class MEM> struct _set_results_t: public array_t<_set_result_t, MEM>
+{};
+
+/*
+ * 多表达式集合: 所有表达式并为一个DFA, 一遍扫描即可得到各表达式的匹配.
+ * 每个起点上按并集做最左最长匹配, 同时报告在该起点匹配的每个表达式各自最长的结果,
+ * 下一次从其中最远的结束位置继续
+ */
+template <class MEM> struct re_set_t: public re_t<MEM>
+{
+    typedef re_t<MEM> base_t;
+    typedef typename base_t::arena_t arena_t;
+    typedef typename base_t::tree_t tree_t;
+    typedef typename base_t::state_t state_t;
+    typedef typename base_t::state_array_t state_array_t;
+    typedef typename base_t::state_iterator_t state_iterator_t;
+    typedef _set_results_t<MEM> set_results_t;
+
+    size_t _count;
+    U32* _okoff;   // 状态s接受的表达式为 _okids[_okoff[s]] ... _okids[_okoff[s + 1] - 1]
+    U32* _okids;
+    const unsigned char** _ends;
+    array_t<U32, MEM> _touched;
+
+    using base_t::search;
+
+    re_set_t(): base_t(), _count(0), _okoff(NULL), _okids(NULL), _ends(NULL)
+    {}
+
+    re_set_t(const char* const* exps, size_t n, long flag = 0): base_t(), _count(0), _okoff(NULL), _okids(NULL), _ends(NULL)
+    {
+        compile(exps, n, flag);
+    }
+
+    ~re_set_t()
+    {
+        release();
+    }
+
+private:
+    re_set_t(const re_set_t&);  // 各表达式的接受表尚不能共享, 暂不支持复制
+    re_set_t& operator =(const re_set_t&);
+
+public:
+
+    error_t compile(const char* const* exps, const size_t* lens, size_t n, long flag = 0)
+    {
+        release();
+        this->__set_flag(flag & MATCH_ICASE);
+
+        arena_t arena;
+        tree_t tree(NULL, 0);
+        error_t ret = tree.build_union(exps, lens, n);
+        if (ret == NO_ERR)
+        {
+            if (this->_ignorecase)
+            {
+                tree.ignore_case();
+            }
+            state_array_t states;
+            if ((ret = this->__generate_states(tree, states)) == NO_ERR)
+            {
+                this->__set_acceptions(states, tree);
+                this->__sort_states(states);
+                __set_pattern_ids(states, tree);
+                this->__generate_classes(tree);
+                if (this->_num <= THR)
+                {
+                    this->__generate_DFA_bthr(states, tree);
+                    this->__generate_scanner(tree);
+                    this->_match_fun = &base_t::__match_bthr;
+                    this->__set_engine(base_t::ENGINE_WITHOUT_PREFIX_BTHR);
+                }
+                else
+                {
+                    this->__generate_DFA_athr(states, tree);
+                    this->__generate_scanner(tree);
+                    this->_match_fun = &base_t::__match_athr;
+                    this->__set_engine(base_t::ENGINE_WITHOUT_PREFIX_ATHR);
+                }
+                for (state_iterator_t i = states.begin(); i != states.end(); i++)
+                {
+                    state_t::release(*i);
+                }
+            }
+        }
+        this->__publish();
+        return ret;
+    }
+
+    error_t compile(const char* const* exps, size_t n, long flag = 0)
+    {
+        array_t<size_t, MEM> lens(n);
+        for (size_t i = 0; i < n; i++)
+        {
+            lens.append(strlen(exps[i]));
+        }
+        return compile(exps, lens.begin(), n, flag);
+    }
+
+    // 表达式个数. 不叫count, 以免遮住re_t::count(p, e)
+    size_t pattern_count() const
+    {
+        return _count;
+    }
+
+    size_t search(const unsigned char* p, const unsigned char* e, set_results_t& results, long n = SEARCH_ALL)
+    {
+        size_t s0 = results.size();
+        if (p < e && this->_accept)
+        {
+            if (this->_trans)
+            {
+                __search_set<unsigned char>(this->_trans, 0xfe, p, e, results, n);
+            }
+            else
+            {
+                __search_set<U16>(this->_wtrans, 0xfffe, p, e, results, n);
+            }
+        }
+        return results.size() - s0;
+    }
+
+    size_t search(const char* p, const char* e, set_results_t& results, long n = SEARCH_ALL)
+    {
+        return search((const unsigned char*)p, (const unsigned char*)e, results, n);
+    }
+
+    size_t search(const char* p, set_results_t& results, long n = SEARCH_ALL)
+    {
+        return search((const unsigned char*)p, (const unsigned char*)(p + strlen(p)), results, n);
+    }
+
+    void release()
+    {
+        MEM::deallocate(_okoff);
+        MEM::deallocate(_okids);
+        MEM::deallocate(_ends);
+        _okoff = _okids = NULL;
+        _ends = NULL;
+        _count = 0;
+        _touched.clear();
+        base_t::release();
+    }
+
+    void __set_pattern_ids(state_array_t& states, const tree_t& tree)
+    {
+        size_t total = 0, k = 0;
+        _count = tree.receptions.size();
+        for (state_iterator_t i = states.begin(); i != states.end(); i++)
+        {
+            for (size_t j = 0; j < _count; j++)
+            {
+                total += (*i)->has(tree.receptions[j]);
+            }
+        }
+        _okoff = (U32*)MEM::allocate((states.size() + 1) * sizeof(U32));
+        _okids = (U32*)MEM::allocate((total + 1) * sizeof(U32));
+        _ends = (const unsigned char**)MEM::allocate(_count * sizeof(const unsigned char*));
+        memset(_ends, 0, _count * sizeof(const unsigned char*));
+        for (state_iterator_t i = states.begin(); i != states.end(); i++)
+        {
+            _okoff[(*i)->id] = (U32)k;
+            for (size_t j = 0; j < _count; j++)
+            {
+                if ((*i)->has(tree.receptions[j]))
+                {
+                    _okids[k++] = (U32)j;
+                }
+            }
+        }
+        _okoff[states.size()] = (U32)k;
+    }
+
+    __must_inline(void) __record(size_t s, const unsigned char* x)
+    {
+        for (const U32 *i = _okids + _okoff[s], *e = _okids + _okoff[s + 1]; i != e; i++)
+        {
+            if (!_ends[*i])
+            {
+                _touched.append(*i);
+            }
+            _ends[*i] = x;
+        }
+    }
+
+    template <class T> int __search_set(const T* trans, size_t bad, const unsigned char* p, const unsigned char* e, set_results_t& results, long n)
+    {
+        const unsigned char* classes = this->_classes;
+        unsigned char cshift = this->_cshift;
+        const bool* accept = this->_accept;
+        size_t s;
+        const unsigned char *x, *y;
+        while (p != e)
+        {
+            if ((p = this->_scanner.scan(p, e)) != e)
+            {
+                s = trans[classes[*p]];
+                x = p + 1;
+                y = NULL;
+                if (accept[s])
+                {
+                    __record(s, x);
+                    y = x;
+                }
+                while (x != e)
+                {
+                    if ((s = trans[(s << cshift) + classes[*x++]]) >= bad)
+                    {
+                        break;
+                    }
+                    if (accept[s])
+                    {
+                        __record(s, x);
+                        y = x;
+                    }
+                }
+                if (y)
+                {
+                    U32 *i, *j, v;
+                    for (i = _touched.begin() + 1; i < _touched.end(); i++)
+                    {
+                        for (v = *i, j = i; j > _touched.begin() && *(j - 1) > v; j--)
+                        {
+                            *j = *(j - 1);
+                        }
+                        *j = v;
+                    }
+                    for (i = _touched.begin(); i != _touched.end(); i++)
+                    {
+                        if (n)
+                        {
+                            results.append(_set_result_t(p, _ends[*i], *i));
+                            n--;
+                        }
+                        _ends[*i] = NULL;
+                    }
+                    _touched.clear();
+                    if (!n)
+                    {
+                        return RESULTS_ENOUGH;
+                    }
+                    p = y;
+                }
+                else
+                {
+                    p++;
+                }
+            }
+        }
+        return RESULTS_NOT_ENOUGH;
+    }
+};
+
+#ifdef _RE_CONSTEXPR
+/*
+ * 编译期编译: 在常量求值中直接由表达式求出Glushkov位置集合(不经过_APE_t和_tree_t, 它们依赖堆分配),
+ * 再做子集构造. 位置集合用U64表示, 最多63个字符位置, 另加一个表示接受的位置.
+ * 语法和re_t一致, 不支持MATCH_WORD等需要运行期辅助结构的选项
+ */
+struct _static_compiler_t
+{
+    struct frag_t
+    {
+        U64 first;
+        U64 last;
+        bool nul;
+    };
+
+    static constexpr size_t MAX_POS = 63;
+
+    const char* exp = NULL;
+    size_t len = 0;
+    size_t i = 0;
+    bool icase = false;
+    error_t err = NO_ERR;
+    size_t npos = 0;
+    U64 follow[MAX_POS + 1] = {};
+    U64 charset[MAX_POS + 1][4] = {};
+    bool matchbegin = false;
+    bool matchend = false;
+    U64 start = 0;
+
+    constexpr void compile(const char* s, size_t n, long flag)
+    {
+        exp = s;
+        len = n;
+        icase = (flag & MATCH_ICASE) != 0;
+        if (flag & ~MATCH_ICASE)
+        {
+            err = NOT_SUPPORT;
+            return;
+        }
+        if (len && exp[0] == '^')
+        {
+            matchbegin = true;
+            i = 1;
+        }
+        if (len > i && exp[len - 1] == '$')
+        {
+            matchend = true;
+            len--;
+        }
+        if (i == len)
+        {
+            err = ERR_EMP;
+            return;
+        }
+        frag_t root = __alt();
+        if (err == NO_ERR && i != len)
+        {
+            err = ERR_PAT;  // 多余的')'
+        }
+        U64 all[4] = {};
+        frag_t ok = __pos(all);  // 接受位置, 不匹配任何字节
+        root = __cat(root, ok);
+        start = root.first;
+    }
+
+    static constexpr void __add(U64* set, unsigned char c)
+    {
+        set[c >> 6] |= (U64)1 << (c & 63);
+    }
+
+    static constexpr bool __has(const U64* set, unsigned char c)
+    {
+        return (set[c >> 6] >> (c & 63)) & 1;
+    }
+
+    static constexpr void __add_chars(U64* set, const char* s)
+    {
+        while (*s)
+        {
+            __add(set, (unsigned char)*s++);
+        }
+    }
+
+    static constexpr void __invert(U64* set)
+    {
+        for (int k = 0; k < 4; k++)
+        {
+            set[k] = ~set[k];
+        }
+    }
+
+    constexpr frag_t __pos(const U64* set)
+    {
+        if (npos > MAX_POS)
+        {
+            err = NOT_SUPPORT;
+            return frag_t{0, 0, false};
+        }
+        for (int c = 0; c < 256; c++)
+        {
+            if (__has(set, (unsigned char)c))
+            {
+                __add(charset[npos], (unsigned char)c);
+                if (icase && c >= 'a' && c <= 'z')
+                {
+                    __add(charset[npos], (unsigned char)(c - 32));
+                }
+                else if (icase && c >= 'A' && c <= 'Z')
+                {
+                    __add(charset[npos], (unsigned char)(c + 32));
+                }
+            }
+        }
+        U64 bit = (U64)1 << npos++;
+        return frag_t{bit, bit, false};
+    }
+
+    constexpr void __link(U64 from, U64 to)
+    {
+        for (size_t k = 0; k < npos; k++)
+        {
+            if ((from >> k) & 1)
+            {
+                follow[k] |= to;
+            }
+        }
+    }
+
+    constexpr frag_t __cat(frag_t a, frag_t b)
+    {
+        __link(a.last, b.first);
+        return frag_t{a.first | (a.nul? b.first: 0), b.last | (b.nul? a.last: 0), a.nul && b.nul};
+    }
+
+    constexpr frag_t __star(frag_t a, bool nul)
+    {
+        __link(a.last, a.first);
+        return frag_t{a.first, a.last, nul || a.nul};
+    }
+
+    constexpr frag_t __alt()
+    {
+        frag_t x = __seq();
+        while (err == NO_ERR && i < len && exp[i] == '|')
+        {
+            i++;
+            frag_t y = __seq();
+            x = frag_t{x.first | y.first, x.last | y.last, x.nul || y.nul};
+        }
+        return x;
+    }
+
+    constexpr frag_t __seq()
+    {
+        frag_t x{0, 0, true};
+        bool empty = true;
+        while (err == NO_ERR && i < len && exp[i] != '|' && exp[i] != ')')
+        {
+            x = __cat(x, __repeat());
+            empty = false;
+        }
+        if (empty && err == NO_ERR)
+        {
+            err = ERR_SYN;
+        }
+        return x;
+    }
+
+    // 重复{m,n}把原子重新解析若干次, 得到各自的位置
+    constexpr frag_t __repeat()
+    {
+        size_t at = i;
+        frag_t x = __atom();
+        bool quantified = false;
+        while (err == NO_ERR && i < len)
+        {
+            size_t m = 0, n = 0, after = i;
+            char c = exp[i];
+            if (c == '*' || c == '+' || c == '?')
+            {
+                i++;
+                x = c == '?'? frag_t{x.first, x.last, true}: __star(x, c == '*');
+            }
+            else if (c == '{' && __range(m, n))
+            {
+                if (n < m)
+                {
+                    err = ERR_RNG;
+                    break;
+                }
+                after = i;
+                frag_t r{0, 0, true};
+                for (size_t k = 0; k < m; k++)
+                {
+                    r = __cat(r, k? __reparse(at, after): x);
+                }
+                if (n == UNBOUNDED)
+                {
+                    r = __cat(r, __star(m? __reparse(at, after): x, true));
+                }
+                else for (size_t k = m; k < n; k++)
+                {
+                    frag_t y = k? __reparse(at, after): x;
+                    r = __cat(r, frag_t{y.first, y.last, true});
+                }
+                x = r;
+            }
+            else
+            {
+                break;
+            }
+            if (quantified)
+            {
+                err = ERR_SYN;  // 与re_t相同, 不允许连续的重复符
+            }
+            quantified = true;
+        }
+        return x;
+    }
+
+    constexpr frag_t __reparse(size_t at, size_t after)
     {
-        E--;
-        const unsigned char* p = P;
-        ptrdiff_t len = E - p;
-        while (len > 0 && (p = __memchr(p, *_prefix, len)))
+        i = at;
+        frag_t x = __atom();
+        i = after;
+        return x;
+    }
+
+    // {m}, {m,}, {,n}, {m,n}; 格式不对时'{'作为普通字符
+    constexpr bool __range(size_t& m, size_t& n)
+    {
+        size_t k = i + 1;
+        bool digits = false;
+        m = n = 0;
+        while (k < len && exp[k] >= '0' && exp[k] <= '9')
         {
-            if (*(const unsigned short*)p == *(const unsigned short*)_prefix) return p;
-            len = E - ++p;
+            m = m * 10 + (exp[k++] - '0');
+            digits = true;
         }
-        return NULL;
+        if (k < len && exp[k] == '}' && digits)
+        {
+            n = m;
+        }
+        else if (k < len && exp[k] == ',')
+        {
+            k++;
+            while (k < len && exp[k] >= '0' && exp[k] <= '9')
+            {
+                n = n * 10 + (exp[k++] - '0');
+            }
+            if (k == len || exp[k] != '}')
+            {
+                return false;
+            }
+            if (!n)
+            {
+                n = UNBOUNDED;
+            }
+        }
+        else
+        {
+            return false;
+        }
+        i = k + 1;
+        return true;
     }
 
-    const unsigned char* __sp3(const unsigned char* P, const unsigned char* E)
+    constexpr frag_t __atom()
     {
-        E -= 2;
-        const unsigned char* p = P;
-        ptrdiff_t len = E - p;
-        unsigned short v = *(unsigned short*)(_prefix + 1);
-        while (len > 0 && (p = __memchr(p, *_prefix, len)))
+        U64 set[4] = {};
+        char c = exp[i++];
+        switch (c)
         {
-            if (*(const unsigned short*)(p + 1) == v) return p;
-            len = E - ++p;
+            case '(':
+            {
+                frag_t x = __alt();
+                if (err == NO_ERR && (i == len || exp[i] != ')'))
+                {
+                    err = ERR_PAT;
+                }
+                i++;
+                return x;
+            }
+            case '*': case '+': case '?':
+                err = ERR_SYN;
+                return frag_t{0, 0, false};
+            case '[':
+                __set(set);
+                break;
+            case '.':
+                __invert(set);
+                break;
+            case '\\':
+                __escape(set);
+                break;
+            default:
+                __add(set, (unsigned char)c);
         }
-        return NULL;
+        return __pos(set);
     }
 
-    #define __SUNDAY_SEARCH(fun_name, __mem_neq__) \
-    const unsigned char* fun_name (const unsigned char* P, const unsigned char* E)\
-    {\
-        const unsigned char *p = P, *e = P + _prelen;\
-        while (__exp1(e < E))\
-        {\
-            if (__exp1(__mem_neq__))\
-            {\
-                p += _pretable[*e]; e += _pretable[*e]; continue;\
-            }\
-            return p;\
-        }\
-        if (__exp0(e == E && !(__mem_neq__))) return p;\
-        return NULL;\
+    // 转义, 返回单个字符, 字符类返回-1
+    constexpr int __escape(U64* set)
+    {
+        if (i == len)
+        {
+            err = ERR_ESC;
+            return -1;
+        }
+        char c = exp[i++];
+        switch (c)
+        {
+            case 'd': case 'D':
+                for (char x = '0'; x <= '9'; x++)
+                {
+                    __add(set, (unsigned char)x);
+                }
+                break;
+            case 'w': case 'W':
+                __add_chars(set, WORD_CHARS);
+                break;
+            case 's': case 'S':
+                __add_chars(set, SPACES);
+                break;
+            case '\\': case '{': case '}': case '[': case ']':
+            case '.': case '*': case '?': case '+': case '|':
+            case '-': case '^': case '$':
+                __add(set, (unsigned char)c);
+                return (unsigned char)c;
+            case 'x':
+            {
+                int h0 = i + 1 < len? __hex(exp[i]): -1;
+                int h1 = i + 1 < len? __hex(exp[i + 1]): -1;
+                if (h0 == -1 || h1 == -1)
+                {
+                    err = ERR_HEX;
+                    return -1;
+                }
+                i += 2;
+                __add(set, (unsigned char)((h0 << 4) + h1));
+                return (h0 << 4) + h1;
+            }
+            default:
+                err = ERR_ESC;
+                return -1;
+        }
+        if (c == 'D' || c == 'W' || c == 'S')
+        {
+            __invert(set);
+        }
+        return -1;
     }
-    __SUNDAY_SEARCH (__sp4,  *(U32*)p != *(U32*)_prefix)
-    __SUNDAY_SEARCH (__sp5,  *(U32*)p != *(U32*)_prefix || *(p + 4) != *(_prefix + 4))
-    __SUNDAY_SEARCH (__sp6,  *(U32*)p != *(U32*)_prefix || *(U16*)(p + 4) != *(U16*)(_prefix + 4))
-    __SUNDAY_SEARCH (__sp7,  *(U32*)p != *(U32*)_prefix || *(U16*)(p + 4) != *(U16*)(_prefix + 4) || *(p + 6) != *(_prefix + 6))
-    __SUNDAY_SEARCH (__sp8,  *(U64*)p != *(U64*)_prefix)
-    __SUNDAY_SEARCH (__sp9,  *(U64*)p != *(U64*)_prefix || *(p + 8) != *(_prefix + 8))
-    __SUNDAY_SEARCH (__sp10, *(U64*)p != *(U64*)_prefix || *(U16*)(p + 8) != *(U16*)(_prefix + 8))
-    __SUNDAY_SEARCH (__sp11, *(U64*)p != *(U64*)_prefix || *(U16*)(p + 8) != *(U16*)(_prefix + 8) || *(p + 10) != *(_prefix + 10))
-    __SUNDAY_SEARCH (__sp12, *(U64*)p != *(U64*)_prefix || *(U32*)(p + 8) != *(U32*)(_prefix + 8))
-    __SUNDAY_SEARCH (__sp13, *(U64*)p != *(U64*)_prefix || *(U32*)(p + 8) != *(U32*)(_prefix + 8) || *(p + 12) != *(_prefix + 12))
-    __SUNDAY_SEARCH (__sp14, *(U64*)p != *(U64*)_prefix || *(U32*)(p + 8) != *(U32*)(_prefix + 8) || *(U16*)(p + 12) != *(U16*)(_prefix + 12))
-    __SUNDAY_SEARCH (__sp15, *(U64*)p != *(U64*)_prefix || *(U32*)(p + 8) != *(U32*)(_prefix + 8) || *(U16*)(p + 12) != *(U16*)(_prefix + 12) || *(p + 14) != *(_prefix + 14))
-    __SUNDAY_SEARCH (__sp16, *(U64*)p != *(U64*)_prefix || *(U64*)(p + 8) != *(U64*)(_prefix + 8))
-    #undef __SUNDAY_SEARCH
 
-    __must_inline(bool) __spx_mem_neq(const unsigned char* p)
+    static constexpr int __hex(char x)
     {
-        const unsigned char* q = _prefix + 16;
-        const unsigned char* r = _prefix + _prelen;
-        while (q != r && *q == *p)
+        return x >= '0' && x <= '9'? x - '0': x >= 'a' && x <= 'f'? x - 'a' + 10: x >= 'A' && x <= 'F'? x - 'A' + 10: -1;
+    }
+
+    /*
+     * 与_APE_t::__parse_set相同: 开头的^取反, 两个单字符之间的-表示范围,
+     * -在首尾时按字面, 范围的一端是字符类时出错, 其余字符按字面
+     */
+    constexpr void __set(U64* set)
+    {
+        bool reverse = false;
+        if (i + 1 < len && exp[i] == '^' && exp[i + 1] != ']')
         {
-            p++;
-            q++;
+            reverse = true;
+            i++;
+        }
+        size_t b = i;
+        int prev = -1;  // 上一个单字符, 字符类为-1
+        while (err == NO_ERR && i < len && exp[i] != ']')
+        {
+            if (exp[i] == '-' && i > b && i + 1 < len && exp[i + 1] != ']')
+            {
+                U64 one[4] = {};
+                i++;
+                int hi = __set_item(one);
+                if (prev < 0 || hi < 0)
+                {
+                    err = ERR_SET;
+                    return;
+                }
+                for (int c = prev < hi? prev: hi; c <= (prev < hi? hi: prev); c++)
+                {
+                    __add(set, (unsigned char)c);
+                }
+                prev = hi;
+            }
+            else
+            {
+                prev = __set_item(set);
+            }
+        }
+        if (i == len || i == b)
+        {
+            if (err == NO_ERR)
+            {
+                err = ERR_SET;
+            }
+            return;
+        }
+        i++;
+        if (reverse)
+        {
+            __invert(set);
         }
-        return q != r;
     }
 
-    const unsigned char* __spx(const unsigned char* P, const unsigned char* E)
+    constexpr int __set_item(U64* set)
     {
-        #define __mem_neq__ *(U64*)p != *(U64*)_prefix || *(U64*)(p + 8) != *(U64*)(_prefix + 8) || __spx_mem_neq(p + 16)
-        const unsigned char *p = P, *e = P + _prelen;
-        while (e < E)
+        if (exp[i] == '\\')
         {
-            if (__exp1(__mem_neq__))
+            i++;
+            return __escape(set);
+        }
+        __add(set, (unsigned char)exp[i]);
+        return (unsigned char)exp[i++];
+    }
+};
+
+
+/*
+ * compile_static生成的DFA, 转移表按字节直接索引, 状态数不超过S.
+ * match和search的结果与用同样的表达式和MATCH_ICASE编译的re_t相同.
+ * fwd(以.*开头)和rev(从右向左识别匹配的前缀)也不超过S个状态时, search按三段式搜索, 见re_t::__deal_with_reverse
+ */
+template <size_t S> struct static_re_t
+{
+    static_assert(S > 0 && S < 0xff, "static_re_t supports at most 254 states");
+
+    static constexpr unsigned char DEAD = 0xff;
+
+    error_t err = NO_ERR;
+    size_t num = 0;
+    bool matchbegin = false;
+    bool matchend = false;
+    bool accept[S] = {};
+    unsigned char trans[S * 256] = {};
+    bool threephase = false;
+    bool fwdaccept[S] = {};
+    bool revaccept[S] = {};
+    unsigned char fwd[S * 256] = {};
+    unsigned char rev[S * 256] = {};
+
+    constexpr bool ok() const
+    {
+        return err == NO_ERR;
+    }
+
+    // C为char或unsigned char, 在常量表达式中也可以使用
+    template <class C> constexpr const C* match(const C* p, const C* e) const
+    {
+        const C* r = NULL;
+        size_t s = 0;
+        while (p < e && (s = trans[(s << 8) + (unsigned char)*p++]) != DEAD)
+        {
+            if (accept[s] && (!matchend || p == e))
             {
-                p += _pretable[*e]; e += _pretable[*e]; continue;
+                r = p;
             }
-            return p;
         }
-        if (__exp0(e == E && !(__mem_neq__)))
+        return r;
+    }
+
+    template <class MEM> size_t search(const unsigned char* p, const unsigned char* e, _results_t<MEM>& results, long n = SEARCH_FIRST) const
+    {
+        size_t s0 = results.size();
+        const unsigned char* y;
+        if (matchbegin)
         {
-            return p;
+            if (p < e && (y = match(p, e)))
+            {
+                results.append(_result_t(p, y));
+            }
+            return results.size() - s0;
         }
-        return NULL;
-        #undef __mem_neq__
+        const unsigned char *q, *x, *stop = p;
+        while (threephase && p < e)
+        {
+            while (p < e && trans[*p] == DEAD)
+            {
+                p++;
+            }
+            if (p == e)
+            {
+                break;
+            }
+            // 通常第一个可能的起点就是匹配的起点, 直接扫描一遍; 从这里失败后, 在扫描过的范围内改用三段式
+            if (p >= stop && (y = __longest(p, e, stop)))
+            {
+                q = p;
+            }
+            else
+            {
+                // 最早的匹配结束位置x
+                size_t s = 0;
+                x = p;
+                while (x < e && !fwdaccept[s])
+                {
+                    s = fwd[(s << 8) + *x++];
+                }
+                if (!fwdaccept[s])
+                {
+                    break;
+                }
+                // 起点的下界q, 再从q开始找最左最长的匹配, 在x之前一定能找到
+                q = x;
+                s = 0;
+                while (x > p && (s = rev[(s << 8) + *--x]) != DEAD)
+                {
+                    if (revaccept[s])
+                    {
+                        q = x;
+                    }
+                }
+                while (!(y = match(q, e)))
+                {
+                    q++;
+                }
+            }
+            results.append(_result_t(q, y));
+            if (!--n)
+            {
+                break;
+            }
+            p = y;
+        }
+        while (!threephase && p < e)
+        {
+            if (trans[*p] == DEAD)
+            {
+                p++;
+            }
+            else if ((y = match(p, e)))
+            {
+                results.append(_result_t(p, y));
+                if (!--n)
+                {
+                    break;
+                }
+                p = y;
+            }
+            else
+            {
+                p++;
+            }
+        }
+        return results.size() - s0;
+    }
+
+    // 与match相同, stop为扫描停止的位置
+    const unsigned char* __longest(const unsigned char* p, const unsigned char* e, const unsigned char*& stop) const
+    {
+        const unsigned char* r = NULL;
+        size_t s = 0;
+        while (p < e && (s = trans[(s << 8) + *p++]) != DEAD)
+        {
+            if (accept[s])
+            {
+                r = p;
+            }
+        }
+        stop = p;
+        return r;
+    }
+
+    template <class MEM> size_t search(const char* p, const char* e, _results_t<MEM>& results, long n = SEARCH_FIRST) const
+    {
+        return search((const unsigned char*)p, (const unsigned char*)e, results, n);
+    }
+
+    template <class MEM> size_t search(const char* p, _results_t<MEM>& results, long n = SEARCH_FIRST) const
+    {
+        return search(p, p + strlen(p), results, n);
+    }
+
+    constexpr void __build(const _static_compiler_t& c)
+    {
+        U64 okbit = (U64)1 << (c.npos - 1);
+        err = c.err;
+        matchbegin = c.matchbegin;
+        matchend = c.matchend;
+        if (err != NO_ERR)
+        {
+            return;
+        }
+        if (!(num = __subset(c, c.start, ANCHORED, trans, accept)))
+        {
+            err = ERR_TOO_MUCH_STATUS;
+            return;
+        }
+        // 匹配不为空, fwd的起始状态不含接受位置
+        threephase = !matchbegin && !matchend &&
+            __subset(c, c.start & ~okbit, UNANCHORED, fwd, fwdaccept) &&
+            __subset(c, okbit - 1, REVERSE, rev, revaccept);
+    }
+
+    enum { ANCHORED, UNANCHORED, REVERSE };
+
+    /*
+     * 子集构造, 状态按发现顺序编号, 0为起始状态, 返回状态数, 超过S时返回0.
+     * ANCHORED和UNANCHORED的状态是下一个字节可以对应的位置; UNANCHORED每一步都加入起始位置.
+     * REVERSE的状态是前一个字节可以对应的位置, 读到起始位置时加上接受位置
+     */
+    static constexpr size_t __subset(const _static_compiler_t& c, U64 init, int kind, unsigned char* table, bool* acc)
+    {
+        U64 states[S] = {};
+        U64 okbit = (U64)1 << (c.npos - 1);
+        size_t n = 0;
+        states[n++] = init;
+        for (size_t s = 0; s < n; s++)
+        {
+            acc[s] = (states[s] & okbit) != 0;
+            for (int ch = 0; ch < 256; ch++)
+            {
+                U64 t = 0, from = 0;
+                for (size_t k = 0; k + 1 < c.npos; k++)
+                {
+                    if (((states[s] >> k) & 1) && _static_compiler_t::__has(c.charset[k], (unsigned char)ch))
+                    {
+                        from |= (U64)1 << k;
+                        t |= kind == REVERSE? 0: c.follow[k];
+                    }
+                }
+                if (kind == UNANCHORED)
+                {
+                    t |= init;
+                }
+                else if (kind == REVERSE)
+                {
+                    for (size_t k = 0; k + 1 < c.npos; k++)
+                    {
+                        t |= (c.follow[k] & from)? (U64)1 << k: 0;
+                    }
+                    t |= (c.start & from)? okbit: 0;
+                }
+                size_t id = 0;
+                while (id < n && states[id] != t)
+                {
+                    id++;
+                }
+                if (!t)
+                {
+                    id = DEAD;
+                }
+                else if (id == n)
+                {
+                    if (n == S)
+                    {
+                        return 0;
+                    }
+                    states[n++] = t;
+                }
+                table[(s << 8) + ch] = (unsigned char)id;
+            }
+        }
+        return n;
     }
 };
 
+/*
+ * 编译期编译, 例如 static constexpr auto re = myre::compile_static(PAT_IPV4);
+ * 出错时err不为NO_ERR, 可用static_assert(re.ok())在编译时检查
+ */
+template <size_t S = 64, size_t N> constexpr static_re_t<S> compile_static(const char (&exp)[N], long flag = 0)
+{
+    _static_compiler_t c;
+    static_re_t<S> re;
+    c.compile(exp, N - 1, flag);
+    re.__build(c);
+    return re;
+}
+#endif
+
 typedef re_t<default_memory_allocator_t> myre_t;
+typedef re_set_t<default_memory_allocator_t> myre_set_t;
 typedef _results_t<default_memory_allocator_t> results_t;
+typedef _set_results_t<default_memory_allocator_t> set_results_t;
 typedef _result_t result_t;
+typedef _count_sink_t count_sink_t;
+typedef _span_sink_t span_sink_t;
+typedef _set_result_t set_result_t;
+typedef _stream_t<default_memory_allocator_t> stream_t;
+typedef _offset_results_t<default_memory_allocator_t> offset_results_t;
+typedef _offset_result_t offset_result_t;
 
 // examples
 #define PAT_IPV4    "(\\d\\d?\\d?\\.){3}\\d\\d?\\d?"
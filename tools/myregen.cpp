@@ -0,0 +1,58 @@
+/*
+ * 把表达式编译后生成C++头文件, 其中的NAME_match和NAME_search不依赖myre.h:
+ *
+ *     myregen NAME PATTERN OUTPUT [-i]
+ *
+ * -i 忽略大小写
+ */
+#include <cctype>
+#include "../myre.h"
+
+int main(int argc, char** argv)
+{
+    if (argc < 4)
+    {
+        fprintf(stderr, "usage: %s NAME PATTERN OUTPUT [-i]\n", argv[0]);
+        return 2;
+    }
+
+    long flag = 0;
+    for (int i = 4; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-i"))
+        {
+            flag |= myre::MATCH_ICASE;
+        }
+    }
+
+    myre::myre_t re;
+    myre::error_t err = re.compile(argv[2], flag);
+    if (err != myre::NO_ERR)
+    {
+        fprintf(stderr, "compile error %d\n", err);
+        return 1;
+    }
+
+    std::string code;
+    if (re.generate_code(code, argv[1]) != myre::NO_ERR)
+    {
+        fprintf(stderr, "pattern not supported by the generator\n");
+        return 1;
+    }
+
+    std::string guard = "MYRE_GEN_";
+    for (const char* p = argv[1]; *p; p++)
+    {
+        guard += (char)toupper((unsigned char)*p);
+    }
+    guard += "_H";
+
+    FILE* fp = fopen(argv[3], "w");
+    if (!fp)
+    {
+        fprintf(stderr, "cannot open %s\n", argv[3]);
+        return 1;
+    }
+    fprintf(fp, "#ifndef %s\n#define %s\n\n%s\n#endif\n", guard.c_str(), guard.c_str(), code.c_str());
+    return fclose(fp)? 1: 0;
+}